@@ -0,0 +1,205 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+  const unsigned int LEAF_SIZE = 4;
+}
+
+void AABB::Extend(const glm::vec3 &point)
+{
+  this->Min = glm::min(this->Min, point);
+  this->Max = glm::max(this->Max, point);
+}
+
+void AABB::Extend(const AABB &box)
+{
+  if (box.Empty())
+    return;
+  this->Min = glm::min(this->Min, box.Min);
+  this->Max = glm::max(this->Max, box.Max);
+}
+
+AABB AABB::Transformed(const glm::mat4 &matrix) const
+{
+  if (this->Empty())
+    return *this;
+  // Transform the center and grow the extents by the absolute matrix
+  glm::vec3 center = glm::vec3(matrix * glm::vec4(this->Center(), 1.0f));
+  glm::vec3 extents = this->Extents();
+  glm::vec3 radius(0.0f);
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 3; col++)
+      radius[row] += std::fabs(matrix[col][row]) * extents[col];
+  return AABB(center - radius, center + radius);
+}
+
+float AABB::Distance(const glm::vec3 &point) const
+{
+  glm::vec3 outside = glm::max(glm::max(this->Min - point, point - this->Max), glm::vec3(0.0f));
+  return glm::length(outside);
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+  // Gribb/Hartmann: planes are sums and differences of the matrix rows
+  const glm::mat4 &m = viewProjection;
+  for (int i = 0; i < 6; i++)
+  {
+    int row = i / 2;
+    float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+    this->X[i] = m[0][3] + sign * m[0][row];
+    this->Y[i] = m[1][3] + sign * m[1][row];
+    this->Z[i] = m[2][3] + sign * m[2][row];
+    this->W[i] = m[3][3] + sign * m[3][row];
+  }
+  // Padding planes every point is in front of
+  for (int i = 6; i < 8; i++)
+  {
+    this->X[i] = this->Y[i] = this->Z[i] = 0.0f;
+    this->W[i] = 1.0f;
+  }
+  for (int i = 0; i < 8; i++)
+  {
+    this->AbsX[i] = std::fabs(this->X[i]);
+    this->AbsY[i] = std::fabs(this->Y[i]);
+    this->AbsZ[i] = std::fabs(this->Z[i]);
+  }
+}
+
+Frustum::Result Frustum::Test(const AABB &box) const
+{
+  glm::vec3 c = box.Center(), e = box.Extents();
+#ifdef CULLING_SSE
+  __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+  __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+  __m128 zero = _mm_setzero_ps();
+  __m128 outside = zero, intersect = zero;
+  for (int i = 0; i < 8; i += 4)
+  {
+    // distance of the center and projected radius of the box for four planes
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(&this->X[i]), cx), _mm_mul_ps(_mm_load_ps(&this->Y[i]), cy)),
+                          _mm_add_ps(_mm_mul_ps(_mm_load_ps(&this->Z[i]), cz), _mm_load_ps(&this->W[i])));
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(&this->AbsX[i]), ex), _mm_mul_ps(_mm_load_ps(&this->AbsY[i]), ey)),
+                          _mm_mul_ps(_mm_load_ps(&this->AbsZ[i]), ez));
+    outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+    intersect = _mm_or_ps(intersect, _mm_cmplt_ps(_mm_sub_ps(d, r), zero));
+  }
+  if (_mm_movemask_ps(outside))
+    return OUTSIDE;
+  if (_mm_movemask_ps(intersect))
+    return INTERSECT;
+  return INSIDE;
+#else
+  Result result = INSIDE;
+  for (int i = 0; i < 6; i++)
+  {
+    float d = this->X[i] * c.x + this->Y[i] * c.y + this->Z[i] * c.z + this->W[i];
+    float r = this->AbsX[i] * e.x + this->AbsY[i] * e.y + this->AbsZ[i] * e.z;
+    if (d + r < 0.0f)
+      return OUTSIDE;
+    if (d - r < 0.0f)
+      result = INTERSECT;
+  }
+  return result;
+#endif
+}
+
+void BVH::Add(unsigned int kind, unsigned int index, const AABB &bounds)
+{
+  Item item;
+  item.Kind = kind;
+  item.Index = index;
+  item.Bounds = bounds;
+  this->Items.push_back(item);
+}
+
+void BVH::Build()
+{
+  this->Nodes.clear();
+  if (!this->Items.empty())
+    this->build(0, (unsigned int)this->Items.size());
+}
+
+int BVH::build(unsigned int first, unsigned int count)
+{
+  int id = (int)this->Nodes.size();
+  this->Nodes.push_back(Node());
+  AABB bounds, centers;
+  for (unsigned int i = first; i < first + count; i++)
+  {
+    bounds.Extend(this->Items[i].Bounds);
+    centers.Extend(this->Items[i].Bounds.Center());
+  }
+  this->Nodes[id].Bounds = bounds;
+  this->Nodes[id].First = first;
+  this->Nodes[id].Count = count;
+  this->Nodes[id].Left = this->Nodes[id].Right = -1;
+  if (count <= LEAF_SIZE)
+    return id;
+
+  glm::vec3 size = centers.Max - centers.Min;
+  int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+  unsigned int half = count / 2;
+  std::nth_element(this->Items.begin() + first, this->Items.begin() + first + half, this->Items.begin() + first + count,
+                   [axis](const Item &a, const Item &b) { return a.Bounds.Center()[axis] < b.Bounds.Center()[axis]; });
+  int left = this->build(first, half);
+  int right = this->build(first + half, count - half);
+  this->Nodes[id].Left = left;
+  this->Nodes[id].Right = right;
+  return id;
+}
+
+void BVH::Cull(const Frustum &frustum, std::vector<std::vector<unsigned char> > &visible)
+{
+  for (unsigned int i = 0; i < visible.size(); i++)
+    std::fill(visible[i].begin(), visible[i].end(), 0);
+  this->Stats = CullingStats();
+  if (this->Nodes.empty())
+    return;
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0)
+  {
+    const Node &node = this->Nodes[stack[--top]];
+    this->Stats.NodesTested++;
+    Frustum::Result result = frustum.Test(node.Bounds);
+    if (result == Frustum::OUTSIDE)
+      continue;
+    if (result == Frustum::INSIDE)
+    {
+      // the whole subtree is visible, no further tests
+      this->mark(node, visible);
+      continue;
+    }
+    if (node.Left < 0)
+    {
+      for (unsigned int i = node.First; i < node.First + node.Count; i++)
+      {
+        const Item &item = this->Items[i];
+        if (frustum.Test(item.Bounds) == Frustum::OUTSIDE)
+          continue;
+        visible[item.Kind][item.Index] = 1;
+        this->Stats.Visible++;
+      }
+      continue;
+    }
+    stack[top++] = node.Left;
+    stack[top++] = node.Right;
+  }
+  this->Stats.Culled = (unsigned int)this->Items.size() - this->Stats.Visible;
+}
+
+void BVH::mark(const Node &node, std::vector<std::vector<unsigned char> > &visible)
+{
+  for (unsigned int i = node.First; i < node.First + node.Count; i++)
+    visible[this->Items[i].Kind][this->Items[i].Index] = 1;
+  this->Stats.Visible += node.Count;
+}
@@ -0,0 +1,101 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_SSE 1
+#endif
+
+// Axis aligned bounding box
+struct AABB
+{
+  glm::vec3 Min, Max;
+  AABB() : Min(1e30f), Max(-1e30f) {}
+  AABB(glm::vec3 min, glm::vec3 max) : Min(min), Max(max) {}
+  void Extend(const glm::vec3 &point);
+  void Extend(const AABB &box);
+  bool Empty() const { return Min.x > Max.x; }
+  glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+  glm::vec3 Extents() const { return (Max - Min) * 0.5f; }
+  // Distance from a point to the box, 0 inside
+  float Distance(const glm::vec3 &point) const;
+  // Bounds of this box after an affine transform
+  AABB Transformed(const glm::mat4 &matrix) const;
+};
+
+// Six clip planes extracted from a projection * view matrix, stored as
+// structure of arrays (padded to eight planes) so boxes are tested against
+// four planes per SSE instruction.
+class Frustum
+{
+public:
+  enum Result
+  {
+    OUTSIDE,
+    INTERSECT,
+    INSIDE
+  };
+  Frustum() {}
+  explicit Frustum(const glm::mat4 &viewProjection);
+  Result Test(const AABB &box) const;
+
+private:
+  // plane i is X[i] * x + Y[i] * y + Z[i] * z + W[i] >= 0 for points inside
+  alignas(16) float X[8];
+  alignas(16) float Y[8];
+  alignas(16) float Z[8];
+  alignas(16) float W[8];
+  alignas(16) float AbsX[8];
+  alignas(16) float AbsY[8];
+  alignas(16) float AbsZ[8];
+};
+
+// Counters of the last Cull call
+struct CullingStats
+{
+  unsigned int NodesTested;
+  unsigned int Visible;
+  unsigned int Culled;
+  CullingStats() : NodesTested(0), Visible(0), Culled(0) {}
+};
+
+// Bounding volume hierarchy over the static objects of the scene. Every item
+// carries a kind (model mesh, grass patch, water strip, ...) and an index
+// within that kind; culling writes one visibility flag per item into the
+// vector of its kind.
+class BVH
+{
+public:
+  // Adds an item, call Build after all items are added
+  void Add(unsigned int kind, unsigned int index, const AABB &bounds);
+  // Builds the hierarchy, splitting at the median of the longest axis
+  void Build();
+  // Sets visible[kind][index] to 1 for every item intersecting the frustum and 0 otherwise
+  void Cull(const Frustum &frustum, std::vector<std::vector<unsigned char> > &visible);
+  // Bounds of all items, empty before Build
+  AABB Bounds() const { return this->Nodes.empty() ? AABB() : this->Nodes[0].Bounds; }
+  // Counters of the last Cull
+  CullingStats Stats;
+
+private:
+  struct Item
+  {
+    unsigned int Kind, Index;
+    AABB Bounds;
+  };
+  struct Node
+  {
+    AABB Bounds;
+    unsigned int First, Count; // item range of the whole subtree
+    int Left, Right;           // children, -1 for leaves
+  };
+  std::vector<Item> Items;
+  std::vector<Node> Nodes;
+  int build(unsigned int first, unsigned int count);
+  void mark(const Node &node, std::vector<std::vector<unsigned char> > &visible);
+};
+
+#endif
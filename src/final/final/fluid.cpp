@@ -1,10 +1,14 @@
 #include "fluid.h"
+#include "resource_manager.h"
 
 Fluid::Fluid(string vs, string fs, string d_texture, string n_texture) {
 	diff_texture = d_texture;
 	norm_texture = n_texture;
 	fs_filename = fs;
 	vs_filename = vs;
+	tess_program = 0;
+	patch_vao = 0;
+	patch_buffer = 0;
 	initWave();
 	initData();
 }
@@ -186,6 +190,16 @@ void Fluid::calculateWave()
 	}
 }
 
+AABB Fluid::stripBounds(int c) const
+{
+	// gerstnerWave can overshoot up to twice a wave's height
+	float crest = 0.0;
+	for (int w = 0; w < WAVE_COUNT; w++)
+		crest += 2 * water.wave_height[w];
+	return AABB(glm::vec3(START_X + c * LENGTH_X, START_Y, START_Z - 1.0),
+		glm::vec3(START_X + (c + 1) * LENGTH_X, START_Y + (STRIP_LENGTH - 1) * LENGTH_Y, START_Z + crest * HEIGHT_SCALE));
+}
+
 GLuint Fluid::initTexture(const char *filename)
 {
 	int width, height;
@@ -201,75 +215,23 @@ GLuint Fluid::initTexture(const char *filename)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
 	free(pixels);
 	return texture;
 }
 
-void* Fluid::readShader(const char *filename, GLint *length)
-{
-	FILE *f;
-	fopen_s(&f, filename, "r");
-	void *buffer;
-
-	if (!f) {
-		fprintf(stderr, "Unable to open %s for reading\n", filename);
-		return NULL;
-	}
-
-	fseek(f, 0, SEEK_END);
-	*length = ftell(f);
-	fseek(f, 0, SEEK_SET);
-
-	buffer = malloc(*length + 1);
-	*length = fread(buffer, 1, *length, f);
-	fclose(f);
-	((char*)buffer)[*length] = '\0';
-
-	return buffer;
-}
-
-GLuint Fluid::initShader(GLenum type, const char *filename) 
-{
-	GLint length;
-	GLchar *source = (GLchar *)readShader(filename, &length);
-	GLuint shader;
-	GLint shader_ok;
-
-	if (!source)
-		return 0;
-
-	shader = glCreateShader(type);
-	glShaderSource(shader, 1, (const GLchar**)&source, &length);
-	free(source);
-	glCompileShader(shader);
-
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &shader_ok);
-	if (!shader_ok) {
-		fprintf(stderr, "Failed to compile %s:\n", filename);
-		//infoLog(shader, glGetShaderiv, glGetShaderInfoLog);
-		glDeleteShader(shader);
-		getchar();
-	}
-	return shader;
-}
-
 void Fluid::initData()
 {
-	dataset.vertex_shader = initShader(GL_VERTEX_SHADER, vs_filename.c_str());
-	dataset.fragment_shader = initShader(GL_FRAGMENT_SHADER, fs_filename.c_str());
-
-	GLint program_ok;
-	dataset.program = glCreateProgram();
-	glAttachShader(dataset.program, dataset.vertex_shader);
-	glAttachShader(dataset.program, dataset.fragment_shader);
-	glLinkProgram(dataset.program);
-	glGetProgramiv(dataset.program, GL_LINK_STATUS, &program_ok);
-	if (!program_ok) {
+	// the stages are linked (or loaded from the program binary cache) in one go,
+	// with their #include lines expanded; no separate shader objects are kept around
+	dataset.vertex_shader = 0;
+	dataset.fragment_shader = 0;
+	dataset.program = ResourceManager::LoadShader(vs_filename.c_str(), fs_filename.c_str(), nullptr, "gerstner").ID;
+	if (!dataset.program) {
 		fprintf(stderr, "Failed to link shader program:\n");
-		//infoLog(dataset.program, glGetProgramiv, glGetProgramInfoLog);
-		glDeleteProgram(dataset.program);
 		getchar();
 	}
 	glUseProgram(dataset.program);
@@ -277,18 +239,12 @@ void Fluid::initData()
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 
-	GLfloat materAmbient[] = { 0.1, 0.1, 0.3, 1.0 };
-	GLfloat materSpecular[] = { 0.8, 0.8, 0.9, 1.0 };
-	GLfloat lightDiffuse[] = { 0.7, 0.7, 0.8, 1.0 };
-	GLfloat lightAmbient[] = { 0.0, 0.0, 0.0, 1.0 };
-	GLfloat lightSpecular[] = { 1.0, 1.0, 1.0, 1.0 };
-	GLfloat envirAmbient[] = { 0.1, 0.1, 0.3, 1.0 };
-	glUniform4fv(glGetUniformLocation(dataset.program, "materAmbient"), 1, materAmbient);
-	glUniform4fv(glGetUniformLocation(dataset.program, "materSpecular"), 1, materSpecular);
-	glUniform4fv(glGetUniformLocation(dataset.program, "lightDiffuse"), 1, lightDiffuse);
-	glUniform4fv(glGetUniformLocation(dataset.program, "lightAmbient"), 1, lightAmbient);
-	glUniform4fv(glGetUniformLocation(dataset.program, "lightSpecular"), 1, lightSpecular);
-	glUniform4fv(glGetUniformLocation(dataset.program, "envirAmbient"), 1, envirAmbient);
+	setMaterial(dataset.program);
+
+	// per-draw uniforms, camera and light come from the FrameData block
+	dataset.uniforms.model_mat = glGetUniformLocation(dataset.program, "modelMat");
+	dataset.uniforms.normal_mat = glGetUniformLocation(dataset.program, "normalMat");
+	dataset.uniforms.time = glGetUniformLocation(dataset.program, "time");
 
 	dataset.attributes.position = glGetAttribLocation(dataset.program, "position");
 	glGenBuffers(1, &dataset.vertex_buffer);
@@ -303,4 +259,96 @@ void Fluid::initData()
 	dataset.normal_texture = initTexture(norm_texture.c_str());
 	dataset.uniforms.normal_texture = glGetUniformLocation(dataset.program, "textures[1]");
 	glUniform1i(dataset.uniforms.normal_texture, 1);
+}
+
+/**
+* @brief:Lighting constants of gerstner.fs, with the program in use
+*/
+void Fluid::setMaterial(GLuint program)
+{
+	GLfloat materAmbient[] = { 0.1, 0.1, 0.3, 1.0 };
+	GLfloat materSpecular[] = { 0.8, 0.8, 0.9, 1.0 };
+	GLfloat lightDiffuse[] = { 0.7, 0.7, 0.8, 1.0 };
+	GLfloat lightAmbient[] = { 0.0, 0.0, 0.0, 1.0 };
+	GLfloat lightSpecular[] = { 1.0, 1.0, 1.0, 1.0 };
+	GLfloat envirAmbient[] = { 0.1, 0.1, 0.3, 1.0 };
+	glUniform4fv(glGetUniformLocation(program, "materAmbient"), 1, materAmbient);
+	glUniform4fv(glGetUniformLocation(program, "materSpecular"), 1, materSpecular);
+	glUniform4fv(glGetUniformLocation(program, "lightDiffuse"), 1, lightDiffuse);
+	glUniform4fv(glGetUniformLocation(program, "lightAmbient"), 1, lightAmbient);
+	glUniform4fv(glGetUniformLocation(program, "lightSpecular"), 1, lightSpecular);
+	glUniform4fv(glGetUniformLocation(program, "envirAmbient"), 1, envirAmbient);
+}
+
+bool Fluid::initTessellation(GLuint program, float triangleSize)
+{
+	if (!program || !GLAD_GL_VERSION_4_0 || glPatchParameteri == NULL)
+		return false;
+	tess_program = program;
+	glUseProgram(tess_program);
+	setMaterial(tess_program);
+	tess_uniforms.time = glGetUniformLocation(tess_program, "time");
+	tess_uniforms.viewport_size = glGetUniformLocation(tess_program, "viewportSize");
+	glUniform1f(glGetUniformLocation(tess_program, "tessTriangleSize"), triangleSize);
+	glUniform1i(glGetUniformLocation(tess_program, "textures[0]"), 0);
+	glUniform1i(glGetUniformLocation(tess_program, "textures[1]"), 1);
+
+	// the waves never change, only the time
+	GLint sharp[WAVE_COUNT];
+	for (int w = 0; w < WAVE_COUNT; w++)
+		sharp[w] = gerstner_sort[w];
+	glUniform1fv(glGetUniformLocation(tess_program, "waveLength"), WAVE_COUNT, water.wave_length);
+	glUniform1fv(glGetUniformLocation(tess_program, "waveHeight"), WAVE_COUNT, water.wave_height);
+	glUniform1fv(glGetUniformLocation(tess_program, "waveDir"), WAVE_COUNT, water.wave_dir);
+	glUniform1fv(glGetUniformLocation(tess_program, "waveSpeed"), WAVE_COUNT, water.wave_speed);
+	glUniform2fv(glGetUniformLocation(tess_program, "waveStart"), WAVE_COUNT, water.wave_start);
+	glUniform1iv(glGetUniformLocation(tess_program, "waveSharp"), WAVE_COUNT, sharp);
+	glUniform1fv(glGetUniformLocation(tess_program, "gerstnerA"), 22, gerstner_pt_a);
+	glUniform1fv(glGetUniformLocation(tess_program, "gerstnerB"), 22, gerstner_pt_b);
+	glUniform1f(glGetUniformLocation(tess_program, "baseHeight"), START_Z);
+	glUniform1f(glGetUniformLocation(tess_program, "heightScale"), HEIGHT_SCALE);
+	glUniform1f(glGetUniformLocation(tess_program, "normalStep"), LENGTH_X);
+
+	// the same area as the strips, in patches
+	float sizeX = (STRIP_COUNT - 1) * LENGTH_X / TESS_PATCHES, sizeY = (STRIP_LENGTH - 1) * LENGTH_Y / TESS_PATCHES;
+	AABB bounds = stripBounds(0);
+	glUniform2f(glGetUniformLocation(tess_program, "patchSize"), sizeX, sizeY);
+	glUniform2f(glGetUniformLocation(tess_program, "heightRange"), bounds.Min.z, bounds.Max.z);
+	// the most every GL 4.0 implementation supports, about 8 vertices per shortest wave up close
+	glUniform1f(glGetUniformLocation(tess_program, "maxLevel"), 64.0f);
+	GLfloat origins[TESS_PATCHES * TESS_PATCHES * 2];
+	for (int j = 0; j < TESS_PATCHES; j++) {
+		for (int i = 0; i < TESS_PATCHES; i++) {
+			origins[(i + j * TESS_PATCHES) * 2] = START_X + i * sizeX;
+			origins[(i + j * TESS_PATCHES) * 2 + 1] = START_Y + j * sizeY;
+		}
+	}
+
+	glGenVertexArrays(1, &patch_vao);
+	glGenBuffers(1, &patch_buffer);
+	glBindVertexArray(patch_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, patch_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(origins), origins, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, (void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void Fluid::drawTessellated(float viewportWidth, float viewportHeight)
+{
+	glUseProgram(tess_program);
+	glUniform1f(tess_uniforms.time, water.time);
+	glUniform2f(tess_uniforms.viewport_size, viewportWidth, viewportHeight);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, dataset.diffuse_texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, dataset.normal_texture);
+
+	glPatchParameteri(GL_PATCH_VERTICES, 1);
+	glBindVertexArray(patch_vao);
+	glDrawArrays(GL_PATCHES, 0, TESS_PATCHES * TESS_PATCHES);
+	glBindVertexArray(0);
 }
\ No newline at end of file
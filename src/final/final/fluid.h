@@ -17,6 +17,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "util.h"
+#include "culling.h"
 
 using namespace std;
 
@@ -31,6 +32,8 @@ const float LENGTH_X = 0.1;
 const float LENGTH_Y = 0.1;
 const float HEIGHT_SCALE = 3;
 const int DATA_LENGTH = STRIP_LENGTH * 2 * (STRIP_COUNT - 1);
+// patches per side of the tessellated surface
+const int TESS_PATCHES = 8;
 
 // file
 
@@ -95,6 +98,7 @@ struct datas {
 
 	struct {
 		GLint diffuse_texture, normal_texture;
+		GLint model_mat, normal_mat, time;
 	} uniforms;
 
 	struct {
@@ -108,6 +112,10 @@ public:
 	GLfloat vertex_data[DATA_LENGTH * 3];
 	GLfloat normal_data[DATA_LENGTH * 3];
 	GLuint VAO;
+	GLuint tess_program, patch_vao, patch_buffer;
+	struct {
+		GLint time, viewport_size;
+	} tess_uniforms;
 	waves water;
 	datas dataset;
 
@@ -116,6 +124,19 @@ public:
 	void initWave();
 	void initData();
 	void calculateWave();
+	/**
+	* @brief:GL 4.0 path: the surface is drawn as TESS_PATCHES^2 coarse patches
+	* that gerstner_tess.tcs splits by their size on screen, and gerstner_tess.tes
+	* evaluates the waves at every generated vertex, so calculateWave and the
+	* vertex uploads are not needed. Takes a program linked from the gerstner_tess
+	* stages and gerstner.fs and the wanted triangle edge length in pixels.
+	*/
+	bool initTessellation(GLuint program, float triangleSize);
+	// Draws the tessellated surface for the current framebuffer size in pixels
+	void drawTessellated(float viewportWidth, float viewportHeight);
+	// Bounds of triangle strip c (0 <= c < STRIP_COUNT - 1) in the water's model space,
+	// covering the highest crest the waves can reach
+	AABB stripBounds(int c) const;
 private:
 	string diff_texture;
 	string norm_texture;
@@ -125,9 +146,8 @@ private:
 	GLfloat normal[STRIP_COUNT*STRIP_LENGTH * 3];
 	float gerstnerWave(float length, float height, float in, const GLfloat gerstner[22]);
 	int normalizeFunc(float in[], float out[], int count);
+	void setMaterial(GLuint program);
 	static GLuint initTexture(const char *filename);
-	static void* readShader(const char *filename, GLint *length);
-	static GLuint initShader(GLenum type, const char *filename);
 };
 
 
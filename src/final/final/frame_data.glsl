@@ -0,0 +1,15 @@
+// per-frame camera and light data, filled once per frame by FrameUniforms.
+// Mirrors struct FrameData in frame_uniforms.h
+#ifndef FRAME_DATA_GLSL
+#define FRAME_DATA_GLSL
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 lightSpaceMatrix;
+    vec3 viewPos;
+    float Time;
+    vec3 lightPos;
+    float DayCycle;
+};
+#endif
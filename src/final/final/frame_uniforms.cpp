@@ -0,0 +1,38 @@
+#include "frame_uniforms.h"
+
+static_assert(sizeof(FrameData) == 224, "FrameData must match the std140 layout of the FrameData block");
+
+// Instantiate static variables
+GLuint FrameUniforms::UBO = 0;
+
+void FrameUniforms::Init()
+{
+  glGenBuffers(1, &UBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+}
+
+void FrameUniforms::Attach(GLuint program)
+{
+  GLuint index = glGetUniformBlockIndex(program, "FrameData");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, index, FRAME_DATA_BINDING);
+  index = glGetUniformBlockIndex(program, "ShadowData");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, index, SHADOW_DATA_BINDING);
+}
+
+void FrameUniforms::Update(const FrameData &data)
+{
+  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::Clear()
+{
+  glDeleteBuffers(1, &UBO);
+  UBO = 0;
+}
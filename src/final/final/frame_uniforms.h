@@ -0,0 +1,68 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Binding point of the "FrameData" uniform block in every scene shader
+const GLuint FRAME_DATA_BINDING = 0;
+// Binding point of the "ShadowData" block, owned by ShadowCascades
+const GLuint SHADOW_DATA_BINDING = 1;
+
+// CPU mirror of the std140 "FrameData" block, declared once for every shader
+// in frame_data.glsl; keep the two in sync. vec3 members are followed
+// by a float so each pair fills exactly one 16 byte std140 slot.
+struct FrameData
+{
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::mat4 lightSpaceMatrix;
+  glm::vec3 viewPos;
+  float time;     // grass wind time
+  glm::vec3 lightPos;
+  float dayCycle; // cosine of the sun angle, drives the skybox blend
+};
+
+// Owns the uniform buffer holding the camera and light data that is shared
+// by all scene shaders. It is filled once per frame instead of setting the
+// same uniforms on every program.
+class FrameUniforms
+{
+public:
+  // Creates the uniform buffer and binds it to FRAME_DATA_BINDING
+  static void Init();
+  // Points the program's FrameData and ShadowData blocks (if any) at their binding points
+  static void Attach(GLuint program);
+  // Uploads this frame's data
+  static void Update(const FrameData &data);
+  // Deletes the uniform buffer
+  static void Clear();
+
+private:
+  FrameUniforms() {}
+  static GLuint UBO;
+};
+
+// Caches the location of a per-draw uniform so draws skip the string lookup.
+// The location is looked up again when used with a different program.
+class UniformLocation
+{
+public:
+  UniformLocation(const char *name) : Name(name), Program(0), Location(-1) {}
+  GLint Get(GLuint program)
+  {
+    if (program != this->Program)
+    {
+      this->Program = program;
+      this->Location = glGetUniformLocation(program, this->Name);
+    }
+    return this->Location;
+  }
+
+private:
+  const char *Name;
+  GLuint Program;
+  GLint Location;
+};
+
+#endif
@@ -1,49 +1,33 @@
 #version 330
 
-uniform sampler2D textures[2];
+in vec3 position;
+in vec3 normal;
 
-uniform vec4 materAmbient, materSpecular;
-uniform vec4 lightDiffuse, lightAmbient, lightSpecular;
-uniform vec4 envirAmbient;
+#include "frame_data.glsl"
 
-varying vec2 texture_coord;
+uniform mat4 modelMat;
+uniform mat3 normalMat;
+uniform float time;
 
-varying vec3 normalVect;
-varying vec3 lightVect;
-varying vec3 eyeVect;
-varying vec3 halfWayVect;
-varying vec3 reflectVect;
+out vec2 texture_coord;
+
+out vec3 normalVect;
+out vec3 lightVect;
+out vec3 eyeVect;
+out vec3 halfWayVect;
+out vec3 reflectVect;
 
 void main()
 {
-  vec4 diffuse, ambient, globalAmt;
-  vec4 specular;
-  vec3 eyeDir, lightDir, normalDir, halfWayDir, reflectDir;
-  float NdotL, NdotH, NdotR, S, temp, delta, fresnel;
-  float alpha = 0.4;
-  
-  eyeDir = normalize(eyeVect);
-  lightDir = normalize(lightVect);
-  lightDir.y = abs(lightDir.y);
-  normalDir = normalize(normalVect);
-  halfWayDir = normalize(halfWayVect);
-  reflectDir = normalize(reflectVect);
-  
-  
-  NdotL = max(dot(normalDir, lightDir), 0.0);
-  NdotH = max(dot(normalDir, halfWayDir), 0.0);
-  NdotR = max(dot(normalDir, reflectDir), 0.0);
-  
-  delta = acos(NdotH);
-  temp = -1.0 * tan(delta) * tan(delta) / alpha / alpha;
-  S = pow(2.71828, temp) / 4.0 / 3.14159 / alpha / alpha / pow(NdotL*NdotR, 0.5);
-  
-  diffuse = texture2D(textures[0], texture_coord) * lightDiffuse;
-  globalAmt = envirAmbient * materAmbient;
-  ambient = envirAmbient * lightAmbient;
-  specular = materSpecular * lightSpecular;
-  fresnel = 0.4 + 0.6 * pow(1.0 - dot(eyeDir, normalDir), 6.0);
-  specular *= fresnel;
-  
-  gl_FragColor = NdotL * (diffuse + specular * S) + globalAmt;
-}
\ No newline at end of file
+  vec4 worldPos = modelMat * vec4(position, 1.0);
+  gl_Position = projection * view * worldPos;
+
+  // the water surface scrolls slowly along the strips
+  texture_coord = position.xy + vec2(0.0, time * 0.005);
+
+  normalVect = normalMat * normal;
+  lightVect = lightPos - worldPos.xyz;
+  eyeVect = viewPos - worldPos.xyz;
+  halfWayVect = normalize(lightVect) + normalize(eyeVect);
+  reflectVect = reflect(-lightVect, normalize(normalVect));
+}
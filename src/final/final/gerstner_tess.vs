@@ -0,0 +1,9 @@
+#version 400 core
+layout (location = 0) in vec2 aPatch; // first grid position (x, y) of the patch
+
+out vec2 vPatch;
+
+void main()
+{
+    vPatch = aPatch;
+}
@@ -1 +1,9 @@
-#include "grass.h"
\ No newline at end of file
+#include "grass.h"
+
+bool Grass::Instanced = true;
+GrassLod Grass::Lod = {30.0f, 50.0f, 150.0f};
+glm::vec4 Grass::WindTerms(0.0f, 0.0f, 1.0f, 0.0f);
+glm::vec2 Grass::WindSway(0.0f, 1.0f);
+WindField *Grass::Wind = NULL;
+UniformLocation Grass::WindTermsLocation("windTerms"), Grass::WindSwayLocation("windSway");
+unsigned int Grass::BladeVBO = 0;
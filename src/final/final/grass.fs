@@ -1,60 +1,25 @@
 #version 330 core
 out vec4 FragColor;
 
-in GS_OUT {
+in BLADE_OUT {
     vec3 FragPos;
     vec3 Normal;
 	vec2 TexCoord;
-    vec4 FragPosLightSpace;
+	float Fade;
 } fs_in;
 
+// blade colour, the cutout mask in alpha
 uniform sampler2D texture1;
-uniform sampler2D alpha;
-uniform sampler2D shadowMap;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+#include "frame_data.glsl"
 
-float ShadowCalculation(vec4 fragPosLightSpace)
-{
-    // perform perspective divide
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
-    vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(lightPos);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
-    {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
-    }
-    shadow /= 9.0;
-    
-    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
-        
-    return shadow;
-}
+#include "shadow.glsl"
 
 void main()
 {	
 
-    vec3 color = texture(texture1, fs_in.TexCoord).rgb;
+    vec4 blade = texture(texture1, fs_in.TexCoord);
+    vec3 color = blade.rgb;
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightColor = vec3(0.3);
     // ambient
@@ -75,15 +40,15 @@ void main()
 	if (lightDir.y < 0) {
 		shadow = 1;
 	} else {
-		shadow = ShadowCalculation(fs_in.FragPosLightSpace);        
+		shadow = ShadowCalculation(fs_in.FragPos, normal, lightDir);        
 	}       
 	 shadow = min(shadow, 0.75);
     vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;    
     
-   float _alpha = texture(alpha, fs_in.TexCoord).r;
-   if (_alpha < 0.8) {
+   if (blade.a < 0.8) {
    	   discard;
    }
    float gamma = 2.2;
-    FragColor = vec4(pow(lighting.rgb, vec3(1.0/gamma)), 1.0);
+    // distant blades fade out through alpha to coverage
+    FragColor = vec4(pow(lighting.rgb, vec3(1.0/gamma)), fs_in.Fade);
 }
\ No newline at end of file
@@ -4,16 +4,29 @@ layout (triangle_strip, max_vertices = 12) out;
 
 in mat4 matrix[];
 in vec3 Pos[];
+// baked by Grass::MakeBlade
+in vec4 Shape[];
+in vec4 Phase[];
+in vec3 Response[];
 
-uniform float Time;
+#include "frame_data.glsl"
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
-
-out GS_OUT {
+uniform vec3 bladeNormal;
+#ifdef GRASS_WIND_FIELD
+// simulated wind over the area, see WindField
+uniform sampler2D windField;
+uniform vec4 windFieldArea; // xz origin, 1 / extent
+#else
+// time dependent wind terms shared by all blades, see Grass::UpdateWind
+uniform vec4 windTerms;
+#endif
+uniform vec2 windSway;
+
+out BLADE_OUT {
     vec3 FragPos;
     vec3 Normal;
 	vec2 TexCoord;
-    vec4 FragPosLightSpace;
+	float Fade;
 } gs_out;
 
 void main() {
@@ -21,13 +34,7 @@ void main() {
   vec4 v[12];
   vec2 uv[12];
 
-  float _Height = 6, _Width = 0.1;
-  float random = sin(1.57 * fract(Pos[0].x / 3) + 1.57 * fract(Pos[0].z / 3));
-  _Height = _Height + 3 * random;
-  _Width = _Width + random / 50;
-
-  _Height = _Height;
-  _Width = _Width;
+  float _Height = Shape[0].x, _Width = Shape[0].y;
   vec4 root = vec4(Pos[0], 1);
   //处理纹理坐标
   float currentV = 0;
@@ -40,24 +47,15 @@ void main() {
   //风;
   float windCoEff = 0;
   vec2 wind;
-  float oscillateDelta = 0.05;
-  wind = vec2(sin(Time * 3.14 * 5));
-	wind.x += (sin(Time + Pos[0].x / 25) + sin((Time + Pos[0].x / 15) + 50)) * 0.5;
-	wind.y += cos(Time + Pos[0].z / 80);
-	wind *= 0.7 + 0.3 * smoothstep(0.0, 1.0, 1 - random);
-	float oscillationStrength = 2.5f;
-	float sinSkewCoeff = random;
-	float lerpCoeff = (sin(oscillationStrength * Time + sinSkewCoeff) + 1.0) / 2;
-	vec2 leftWindBound = wind * (1.0 - oscillateDelta);
-	vec2 rightWindBound = wind * (1.0 + oscillateDelta);
-
-	wind.x = leftWindBound.x +  (rightWindBound.x - leftWindBound.x) * lerpCoeff;
-	wind.y = leftWindBound.y +  (rightWindBound.y - leftWindBound.y) * lerpCoeff;
-
-	float randomAngle = 3.14 * random;
-	float randomMagnitude = random;
-	vec2 randomWindDir = vec2(sin(randomAngle), cos(randomAngle));
-	wind += randomWindDir * randomMagnitude;
+#ifdef GRASS_WIND_FIELD
+  wind = texture(windField, ((model * root).xz - windFieldArea.xy) * windFieldArea.zw).rg;
+#else
+  wind = vec2(windTerms.x);
+	wind.x += 0.5 * (windTerms.y * Phase[0].x + windTerms.z * Phase[0].y);
+	wind.y += windTerms.z * Phase[0].z - windTerms.y * Phase[0].w;
+#endif
+	wind *= dot(Response[0], vec3(1.0, windSway));
+	wind += Shape[0].zw;
 
 	float windForce = length(wind); 
   for (int i = 0; i < vertexCount; i++)
@@ -89,9 +87,9 @@ void main() {
   for (int i = 0; i < vertexCount; i++) {
     gl_Position = matrix[0] * v[i];
 	gs_out.TexCoord = uv[i];
+	gs_out.Fade = 1.0;
 	gs_out.FragPos = vec3(model * v[i]);
-	gs_out.Normal = transpose(inverse(mat3(model))) * vec3(0, 0, 1);
-	gs_out.FragPosLightSpace = lightSpaceMatrix * vec4(gs_out.FragPos, 1.0);
+	gs_out.Normal = bladeNormal;
     EmitVertex();
   }
   EndPrimitive();
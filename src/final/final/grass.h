@@ -5,79 +5,296 @@
 #include <GLFW/glfw3.h>
 #include <string>
 #include <vector>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
 
 #include <stb_image.h>
 
 #include "object.h"
+#include "culling.h"
+#include "wind_field.h"
 
+// Per-blade instance data, read by grass_instanced.vs (and as points by
+// grass.vs/gs). Everything but the shared wind is baked by Grass::MakeBlade,
+// so the shaders only combine it with the wind terms of the frame.
+struct GrassBlade
+{
+	glm::vec3 Root;     // root position in patch space
+	float Seed;         // pseudo-random value in [0, 1] the rest is derived from
+	glm::vec4 Shape;    // height, half width, random wind direction (xy)
+	glm::vec4 Phase;    // wind phase of the root: x and y of the gust along x, cos and sin of the one along z
+	glm::vec3 Response; // wind response, split to sway with sin and cos of 2.5 t
+};
+
+// Distance cutoffs of the grass level of detail, in world units
+struct GrassLod
+{
+	float MidDistance;  // beyond it blades are drawn with BLADE_LOD_SEGMENTS
+	float ThinDistance; // beyond it the blade density falls off with 1/d^2
+	float MaxDistance;  // no grass is drawn beyond it
+};
+
+// A rectangular field of grass blades. By default every blade is an instance
+// of one shared 12 vertex strip, bent by the wind in grass_instanced.vs; the
+// old path expands one point per blade in grass.gs instead.
+//
+// The instanced path is level-of-detailed by distance (see Lod). Blades are
+// stored in random order, so drawing a prefix of the instance buffer thins
+// the patch evenly. Past ThinDistance only the density a blade at the
+// nearest point of the patch needs is drawn, and the vertex shader fades
+// out the blades around the cut with alpha to coverage. The density falls
+// with the square of the distance, like the screen area of the patch, so
+// the vertex count stays about the same however large the field gets.
 class Grass : public Object
 {
 public:
-	Grass(glm::vec3 pos, glm::vec3 size, glm::vec3 color, int num_row, int num_col, float interval) : Object(pos, size, color)
+	Grass(glm::vec3 pos, glm::vec3 size, glm::vec3 color, int num_row, int num_col, float interval) : Object(pos, size, color), NormalLocation("bladeNormal"), LodLocation("lodDistances"), CountLocation("bladeCount")
 	{
 		this->interval = interval;
 		this->num_col = num_col;
 		this->num_row = num_row;
 		this->InitRenderData();
 	};
+	// A patch of freely placed blades (see GrassScatter), roots in patch space
+	// and spacing the average distance between them
+	Grass(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const std::vector<GrassBlade> &blades, float spacing) : Object(pos, size, color), NormalLocation("bladeNormal"), LodLocation("lodDistances"), CountLocation("bladeCount")
+	{
+		this->interval = spacing;
+		this->num_col = 0;
+		this->num_row = 0;
+		this->Blades = blades;
+		this->upload();
+	};
 	~Grass() {};
 
-	float interval;
-	int num_row;
+	// segments of the blade strip, two vertices per segment boundary
+	static const int BLADE_SEGMENTS = 5;
+	static const int BLADE_VERTICES = 2 * (BLADE_SEGMENTS + 1);
+	// segments of the mid range blade strip
+	static const int BLADE_LOD_SEGMENTS = 2;
+	static const int BLADE_LOD_VERTICES = 2 * (BLADE_LOD_SEGMENTS + 1);
+	// draw blades as instances (grass_instanced.vs) or as points (grass.vs/gs)
+	static bool Instanced;
+	static GrassLod Lod;
+	// Fraction of the blades drawn at a distance, mirrored by grass_instanced.vs, also used by GrassField
+	static float Density(float distance)
+	{
+		float density = 1.0f;
+		if (distance > Lod.ThinDistance)
+			density = (Lod.ThinDistance / distance) * (Lod.ThinDistance / distance);
+		return density * glm::clamp((Lod.MaxDistance - distance) / (0.2f * Lod.MaxDistance), 0.0f, 1.0f);
+	}
+	// wind terms shared by all blades, see UpdateWind
+	static glm::vec4 WindTerms;
+	static glm::vec2 WindSway;
+	// simulated wind sampled by shaders built with GRASS_WIND_FIELD, not owned
+	static WindField *Wind;
+	static const int WIND_TEXTURE_UNIT = 1;
+
+	// Computes the time dependent wind terms once per frame
+	static void UpdateWind(float time)
+	{
+		WindTerms = glm::vec4(glm::sin(time * 3.14f * 5.0f), glm::sin(time), glm::cos(time), 0.0f);
+		WindSway = glm::vec2(glm::sin(2.5f * time), glm::cos(2.5f * time));
+	}
+
+	// Sets the wind terms of a grass program in use, once per frame after UpdateWind
+	static void SetWind(GLuint program)
+	{
+		glUniform4fv(WindTermsLocation.Get(program), 1, glm::value_ptr(WindTerms));
+		glUniform2fv(WindSwayLocation.Get(program), 1, glm::value_ptr(WindSway));
+	}
+
+	// Binds the wind field, if any, for a draw
+	static void BindWind()
+	{
+		if (Wind)
+			Wind->Bind(WIND_TEXTURE_UNIT);
+	}
+
+	// Bakes the per-blade constants, the wind of grass.gs split into the
+	// parts that depend on the blade and the ones shared by all blades:
+	// sin(t + a) + sin(t + b) = sin t (cos a + cos b) + cos t (sin a + sin b)
+	static GrassBlade MakeBlade(glm::vec3 root, float seed)
+	{
+		GrassBlade blade;
+		blade.Root = root;
+		blade.Seed = seed;
+		float angle = 3.14f * seed;
+		blade.Shape = glm::vec4(6.0f + 3.0f * seed, 0.1f + seed / 50.0f, glm::sin(angle) * seed, glm::cos(angle) * seed);
+		float a = root.x / 25.0f, b = root.x / 15.0f + 50.0f, c = root.z / 80.0f;
+		blade.Phase = glm::vec4(glm::cos(a) + glm::cos(b), glm::sin(a) + glm::sin(b), glm::cos(c), glm::sin(c));
+		// bend * (1 + 0.05 sin(2.5 t + seed))
+		float t = 1.0f - seed;
+		float bend = 0.7f + 0.3f * t * t * (3.0f - 2.0f * t);
+		blade.Response = glm::vec3(bend, 0.05f * bend * glm::cos(seed), 0.05f * bend * glm::sin(seed));
+		return blade;
+	}
+
+	float interval; // grid spacing, or average spacing of scattered blades
+	int num_row;    // grid size, 0 for scattered blades
 	int num_col;
-	unsigned int VAO;
+	AABB LocalBounds; // of the blade roots, in patch space
+	unsigned int VAO;      // instanced: shared blade strip + per-blade attributes
+	unsigned int PointVAO; // geometry shader path: one point per blade
+	unsigned int InstanceVBO;
+	std::vector<GrassBlade> Blades; // in instance (random) order, kept for GrassField
 	int size;
+	UniformLocation NormalLocation, LodLocation, CountLocation;
+	static UniformLocation WindTermsLocation, WindSwayLocation;
 
-	void Draw(Shader *shader)
+	void Draw(Shader *shader, const glm::vec3 &viewPos)
 	{
+		int count = this->size, first = 0, vertices = BLADE_VERTICES;
+		if (Instanced)
+		{
+			float distance = this->Bounds().Distance(viewPos);
+			// including the blades fading out past the density
+			count = (int)std::ceil(this->size * std::min(1.25f * Density(distance), 1.0f));
+			if (count == 0)
+				return;
+			if (distance > Lod.MidDistance)
+			{
+				first = BLADE_VERTICES;
+				vertices = BLADE_LOD_VERTICES;
+			}
+		}
 		shader->use();
 		glm::mat4 model(1.0f);
 		model = glm::translate(model, this->Position);
 		model = glm::scale(model, this->Size);
-		shader->setMat4("model", model);
+		glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
+		// every blade faces +z, so the normal is the same for the whole patch
+		glm::vec3 normal = glm::normalize(glm::transpose(glm::inverse(glm::mat3(model))) * glm::vec3(0.0f, 0.0f, 1.0f));
+		glUniform3fv(this->NormalLocation.Get(shader->ID), 1, glm::value_ptr(normal));
+		glUniform3f(this->LodLocation.Get(shader->ID), Lod.MidDistance, Lod.ThinDistance, Lod.MaxDistance);
+		glUniform1i(this->CountLocation.Get(shader->ID), this->size);
+		BindWind();
 		auto texture1 = ResourceManager::GetTexture("t_grass");
 		glActiveTexture(GL_TEXTURE0);
 		texture1.Bind();
-		auto texture2 = ResourceManager::GetTexture("a_grass");
-		glActiveTexture(GL_TEXTURE1);
-		texture2.Bind();
-		glBindVertexArray(this->VAO);
-		glDrawArrays(GL_POINTS, 0, this->size);
+		if (Instanced)
+		{
+			glBindVertexArray(this->VAO);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, first, vertices, count);
+		}
+		else
+		{
+			glBindVertexArray(this->PointVAO);
+			glDrawArrays(GL_POINTS, 0, this->size);
+		}
 		glBindVertexArray(0);
 	}
 
+	// World space bounds of the patch, blades are up to 9 units tall and sway
+	// up to ~3 units in the wind (see grass_instanced.vs)
+	AABB Bounds()
+	{
+		AABB local(this->LocalBounds.Min + glm::vec3(-3.0f, -1.0f, -3.0f), this->LocalBounds.Max + glm::vec3(3.0f, 9.0f, 3.0f));
+		return AABB(this->Position + local.Min * this->Size, this->Position + local.Max * this->Size);
+	}
+
 	void InitRenderData()
 	{
-		int width, height;
-		//unsigned char *image = stbi_load(file, &width, &height, 0, STBI_grey);
-		// Now generate texture
-		std::vector<glm::vec3> vertices;
-		
+		std::vector<GrassBlade> &blades = this->Blades;
+		blades.clear();
+		blades.reserve(num_row * num_col);
 		for (int i = 0; i < num_row; i++)
 		{
 			for (int j = 0; j < num_col; j++)
 			{
-				//glm::vec3 v1(k + 0, static_cast<float>(image[k + i * height]), i + 0);
-				/*if (v1.y < 10 && v1.y > 0)
-					vertices.push_back(v1);*/
-				glm::vec3 v1(j * interval, 0, i * interval);
-				vertices.push_back(v1);
+				glm::vec3 root(j * interval, 0, i * interval);
+				// the hash grass.gs used to derive from the root every frame
+				float seed = glm::sin(1.57f * glm::fract(root.x / 3.0f) + 1.57f * glm::fract(root.z / 3.0f));
+				blades.push_back(MakeBlade(root, seed));
 			}
 		}
-		
+		this->upload();
+	}
 
-		this->size = vertices.size();
+	// Deletes the GL buffers, the blades are kept so the patch can be uploaded again
+	void Release()
+	{
+		glDeleteBuffers(1, &this->InstanceVBO);
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteVertexArrays(1, &this->PointVAO);
+		this->InstanceVBO = this->VAO = this->PointVAO = 0;
+	}
 
-		//stbi_image_free(image);
+	// The unit blade strips shared by all patches, the full one followed by
+	// the mid range one: (side, height) in [0, 1]^2, also the texture coordinate
+	static unsigned int BladeMesh()
+	{
+		if (BladeVBO == 0)
+		{
+			glm::vec2 vertices[BLADE_VERTICES + BLADE_LOD_VERTICES];
+			for (int i = 0; i < BLADE_VERTICES; i++)
+				vertices[i] = glm::vec2(float(i % 2), float(i / 2) / BLADE_SEGMENTS);
+			for (int i = 0; i < BLADE_LOD_VERTICES; i++)
+				vertices[BLADE_VERTICES + i] = glm::vec2(float(i % 2), float(i / 2) / BLADE_LOD_SEGMENTS);
+			glGenBuffers(1, &BladeVBO);
+			glBindBuffer(GL_ARRAY_BUFFER, BladeVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		}
+		return BladeVBO;
+	}
+
+private:
+	static unsigned int BladeVBO;
+
+	// Shuffles the blades and creates the instance buffer and the vertex arrays
+	void upload()
+	{
+		std::vector<GrassBlade> &blades = this->Blades;
+		// shuffle with a fixed seed, so any prefix is an even random subset
+		unsigned int state = 12345u;
+		for (int i = (int)blades.size() - 1; i > 0; i--)
+		{
+			state = state * 1664525u + 1013904223u;
+			std::swap(blades[i], blades[(state >> 8) % (i + 1)]);
+		}
+		this->size = blades.size();
+		this->LocalBounds = AABB();
+		for (size_t i = 0; i < blades.size(); i++)
+			this->LocalBounds.Extend(blades[i].Root);
+
+		glGenBuffers(1, &this->InstanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->InstanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, blades.size() * sizeof(GrassBlade), blades.empty() ? NULL : &blades[0], GL_STATIC_DRAW);
 
-		unsigned int VBO;
 		glGenVertexArrays(1, &this->VAO);
-		glGenBuffers(1, &VBO);
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, BladeMesh());
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+		glBindBuffer(GL_ARRAY_BUFFER, this->InstanceVBO);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (void *)offsetof(GrassBlade, Root));
+		glVertexAttribDivisor(1, 1);
+		bladeAttributes(2, 1);
+
+		glGenVertexArrays(1, &this->PointVAO);
+		glBindVertexArray(this->PointVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->InstanceVBO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (void *)offsetof(GrassBlade, Root));
+		bladeAttributes(1, 0);
+		glBindVertexArray(0);
+	}
+
+	// Points Shape, Phase and Response of the bound buffer at three attributes from location on
+	static void bladeAttributes(GLuint location, GLuint divisor)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (void *)offsetof(GrassBlade, Shape));
+		glVertexAttribDivisor(location, divisor);
+		glEnableVertexAttribArray(location + 1);
+		glVertexAttribPointer(location + 1, 4, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (void *)offsetof(GrassBlade, Phase));
+		glVertexAttribDivisor(location + 1, divisor);
+		glEnableVertexAttribArray(location + 2);
+		glVertexAttribPointer(location + 2, 3, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (void *)offsetof(GrassBlade, Response));
+		glVertexAttribDivisor(location + 2, divisor);
 	}
 };
 
@@ -1,15 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aShape;
+layout (location = 2) in vec4 aPhase;
+layout (location = 3) in vec3 aResponse;
 
-out vec2 TexCoord;
 out vec3 Pos;
+out vec4 Shape;
+out vec4 Phase;
+out vec3 Response;
 
 out mat4 matrix;
 
 
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "frame_data.glsl"
 uniform mat4 model;
 
 
@@ -18,5 +22,8 @@ void main()
   matrix = projection * view * model;
 
   Pos = aPos;
+  Shape = aShape;
+  Phase = aPhase;
+  Response = aResponse;
   gl_Position = projection * view * model * vec4(aPos, 1.0f);
-}
\ No newline at end of file
+}
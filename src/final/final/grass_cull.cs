@@ -0,0 +1,88 @@
+#version 430 core
+// one work group per chunk, GRASS_CHUNK_SIZE blades
+layout (local_size_x = 256) in;
+
+// GrassInstance: root (patch space) and rank or fade, the baked constants
+// of Grass::MakeBlade and the patch in Response.w
+struct Blade
+{
+    vec4 Root;
+    vec4 Shape;
+    vec4 Phase;
+    vec4 Response;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer BladeBuffer { Blade blades[]; };
+// world space bounds per chunk: min, max (w: blade count)
+layout (std430, binding = 1) readonly buffer ChunkBuffer { vec4 chunks[]; };
+layout (std430, binding = 2) writeonly buffer InstanceBuffer { Blade instances[]; };
+// full detail and mid range draws
+layout (std430, binding = 3) buffer CommandBuffer { DrawCommand commands[2]; };
+
+#include "frame_data.glsl"
+// MAX_GRASS_PATCHES
+uniform mat4 patchModels[16];
+// mid, thin and max distance of the level of detail, see GrassLod
+uniform vec3 lodDistances;
+
+shared bool chunkVisible;
+
+// fraction of the blades drawn at a distance, mirrors Grass::Density
+float Density(float dist)
+{
+    float density = 1.0;
+    if (dist > lodDistances.y)
+        density = pow(lodDistances.y / dist, 2.0);
+    return density * clamp((lodDistances.z - dist) / (0.2 * lodDistances.z), 0.0, 1.0);
+}
+
+void main()
+{
+    uint chunk = gl_WorkGroupID.x;
+    vec4 boundsMin = chunks[2u * chunk];
+    vec4 boundsMax = chunks[2u * chunk + 1u];
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        // frustum planes from the rows of the view projection (Gribb/Hartmann),
+        // the chunk is out when its corner farthest along a normal is behind
+        mat4 m = transpose(projection * view);
+        bool visible = true;
+        for (int i = 0; i < 6; ++i)
+        {
+            vec4 plane = m[3] + ((i % 2 == 0) ? 1.0 : -1.0) * m[i / 2];
+            vec3 corner = mix(boundsMin.xyz, boundsMax.xyz, step(0.0, plane.xyz));
+            if (dot(plane.xyz, corner) + plane.w < 0.0)
+                visible = false;
+        }
+        // nothing is drawn past the last LOD distance
+        if (distance(clamp(viewPos, boundsMin.xyz, boundsMax.xyz), viewPos) > lodDistances.z)
+            visible = false;
+        chunkVisible = visible;
+    }
+    barrier();
+    if (!chunkVisible || gl_LocalInvocationIndex >= uint(boundsMax.w))
+        return;
+
+    // thin and fade by the blade's own distance, like grass_instanced.vs
+    Blade blade = blades[gl_GlobalInvocationID.x];
+    int patchIndex = int(blade.Response.w);
+    vec3 root = vec3(patchModels[patchIndex] * vec4(blade.Root.xyz, 1.0));
+    float dist = distance(root, viewPos);
+    float density = Density(dist);
+    float fade = clamp((1.25 * density - blade.Root.w) / (0.25 * density + 1e-4), 0.0, 1.0);
+    if (fade <= 0.0)
+        return;
+
+    uint lod = dist > lodDistances.x ? 1u : 0u;
+    uint slot = atomicAdd(commands[lod].instanceCount, 1u);
+    blade.Root.w = fade;
+    instances[commands[lod].baseInstance + slot] = blade;
+}
\ No newline at end of file
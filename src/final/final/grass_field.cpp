@@ -0,0 +1,240 @@
+#include "grass_field.h"
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Side of the square of grid cells gathered into one chunk
+const int CHUNK_SIDE = 16;
+
+bool GrassField::Supported()
+{
+  return GLAD_GL_VERSION_4_3 != 0;
+}
+
+GrassField::GrassField(Grass **patches, int count, Shader cullShader)
+  : InstanceBuffer(0), CommandBuffer(0), LodVAO(0), CullShader(cullShader), GpuCulled(cullShader.ID != 0 && Supported()),
+    TransformCount(0), ChunkCount(0), Capacity(0), DrawProgram(0)
+{
+  this->DrawCounts[0] = this->DrawCounts[1] = 0;
+  GrassInstance padding;
+  padding.Root = glm::vec4(0.0f, 0.0f, 0.0f, 2.0f);
+  padding.Shape = padding.Phase = padding.Response = glm::vec4(0.0f);
+
+  std::vector<GrassInstance> blades;
+  std::vector<GrassChunk> chunks;
+  for (int p = 0; p < count; p++)
+  {
+    Grass *grass = patches[p];
+    // patches with the same transform (e.g. scattered chunks) share a slot
+    glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), grass->Position), grass->Size);
+    int transform = 0;
+    while (transform < this->TransformCount && this->Models[transform] != model)
+      transform++;
+    if (transform == this->TransformCount)
+    {
+      if (transform == MAX_GRASS_PATCHES)
+      {
+        std::cout << "ERROR::GRASS_FIELD: More than " << MAX_GRASS_PATCHES << " patch transforms, patch " << p << " is not drawn" << std::endl;
+        continue;
+      }
+      this->Models[transform] = model;
+      this->Normals[transform] = glm::normalize(glm::transpose(glm::inverse(glm::mat3(model))) * glm::vec3(0.0f, 0.0f, 1.0f));
+      this->TransformCount++;
+    }
+
+    // gather neighbouring blades, keeping their rank in the shuffled order
+    std::map<std::pair<int, int>, std::vector<GrassInstance> > tiles;
+    const std::vector<GrassBlade> &source = grass->Blades;
+    for (size_t i = 0; i < source.size(); i++)
+    {
+      const GrassBlade &blade = source[i];
+      int column = (int)std::floor(blade.Root.x / grass->interval + 0.5f) / CHUNK_SIDE;
+      int row = (int)std::floor(blade.Root.z / grass->interval + 0.5f) / CHUNK_SIDE;
+      GrassInstance instance;
+      instance.Root = glm::vec4(blade.Root, (i + 0.5f) / source.size());
+      instance.Shape = blade.Shape;
+      instance.Phase = blade.Phase;
+      instance.Response = glm::vec4(blade.Response, (float)transform);
+      tiles[std::make_pair(row, column)].push_back(instance);
+    }
+
+    for (auto &tile : tiles)
+    {
+      const std::vector<GrassInstance> &members = tile.second;
+      for (size_t first = 0; first < members.size(); first += GRASS_CHUNK_SIZE)
+      {
+        size_t last = std::min(members.size(), first + GRASS_CHUNK_SIZE);
+        AABB local;
+        for (size_t i = first; i < last; i++)
+          local.Extend(glm::vec3(members[i].Root));
+        // blades are up to 9 units tall and sway up to ~3 units, as in Grass::Bounds
+        local.Min += glm::vec3(-3.0f, -1.0f, -3.0f);
+        local.Max += glm::vec3(3.0f, 9.0f, 3.0f);
+        GrassChunk chunk;
+        chunk.Min = glm::vec4(grass->Position + local.Min * grass->Size, 0.0f);
+        chunk.Max = glm::vec4(grass->Position + local.Max * grass->Size, (float)(last - first));
+        chunks.push_back(chunk);
+
+        // every chunk starts at a multiple of GRASS_CHUNK_SIZE, the rest is padding
+        blades.insert(blades.end(), members.begin() + first, members.begin() + last);
+        blades.resize(chunks.size() * GRASS_CHUNK_SIZE, padding);
+      }
+    }
+  }
+  this->ChunkCount = chunks.size();
+  this->Capacity = blades.size();
+
+  // created through GL_ARRAY_BUFFER, which every context has, and bound as
+  // storage buffers by Cull
+  glGenBuffers(1, &this->BladeBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, this->BladeBuffer);
+  glBufferData(GL_ARRAY_BUFFER, blades.size() * sizeof(GrassInstance), blades.empty() ? NULL : &blades[0], GL_STATIC_DRAW);
+  glGenBuffers(1, &this->ChunkBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, this->ChunkBuffer);
+  glBufferData(GL_ARRAY_BUFFER, chunks.size() * sizeof(GrassChunk), chunks.empty() ? NULL : &chunks[0], GL_STATIC_DRAW);
+  // full detail blades first, mid range blades from Capacity on
+  glGenBuffers(1, &this->InstanceBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, this->InstanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, 2 * blades.size() * sizeof(GrassInstance), NULL, GL_DYNAMIC_COPY);
+  if (this->GpuCulled)
+  {
+    glGenBuffers(1, &this->CommandBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this->CommandBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_COPY);
+  }
+  else
+  {
+    this->Chunks = chunks;
+    for (size_t i = 0; i < blades.size(); i++)
+      this->Ranks.push_back(blades[i].Root.w);
+  }
+
+  // the indirect draws pick their range with the base instance, without
+  // them the mid range gets a vertex array of its own
+  GLuint *arrays[2] = {&this->VAO, &this->LodVAO};
+  for (int lod = 0; lod < (this->GpuCulled ? 1 : 2); lod++)
+  {
+    glGenVertexArrays(1, arrays[lod]);
+    glBindVertexArray(*arrays[lod]);
+    glBindBuffer(GL_ARRAY_BUFFER, Grass::BladeMesh());
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+    glBindBuffer(GL_ARRAY_BUFFER, this->InstanceBuffer);
+    size_t base = lod * blades.size() * sizeof(GrassInstance);
+    for (int i = 0; i < 4; i++)
+    {
+      glEnableVertexAttribArray(1 + i);
+      glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(GrassInstance), (void *)(base + i * sizeof(glm::vec4)));
+      glVertexAttribDivisor(1 + i, 1);
+    }
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (this->GpuCulled)
+  {
+    this->CullShader.use();
+    this->setUniforms(this->CullShader.ID);
+  }
+}
+
+void GrassField::Cull(const Frustum &frustum, const glm::vec3 &viewPos)
+{
+  if (!this->GpuCulled)
+  {
+    this->DrawCounts[0] = this->DrawCounts[1] = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, this->BladeBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->InstanceBuffer);
+    for (int c = 0; c < this->ChunkCount; c++)
+    {
+      const GrassChunk &chunk = this->Chunks[c];
+      AABB bounds(glm::vec3(chunk.Min), glm::vec3(chunk.Max));
+      float distance = bounds.Distance(viewPos);
+      if (distance >= Grass::Lod.MaxDistance || frustum.Test(bounds) == Frustum::OUTSIDE)
+        continue;
+      // no blade of the chunk is denser than at its nearest point, so the
+      // ones ranked past it fade out everywhere in grass_instanced.vs
+      const float *ranks = &this->Ranks[c * GRASS_CHUNK_SIZE];
+      int count = (int)(std::lower_bound(ranks, ranks + (int)chunk.Max.w, 1.25f * Grass::Density(distance)) - ranks);
+      if (count == 0)
+        continue;
+      int lod = distance > Grass::Lod.MidDistance ? 1 : 0;
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)c * GRASS_CHUNK_SIZE * sizeof(GrassInstance),
+                          (GLintptr)(lod * this->Capacity + this->DrawCounts[lod]) * sizeof(GrassInstance), count * sizeof(GrassInstance));
+      this->DrawCounts[lod] += count;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return;
+  }
+  // empty the two draws, grass_cull.cs counts the instances up
+  DrawArraysIndirectCommand commands[2] = {
+      {(GLuint)Grass::BLADE_VERTICES, 0, 0, 0},
+      {(GLuint)Grass::BLADE_LOD_VERTICES, 0, (GLuint)Grass::BLADE_VERTICES, (GLuint)this->Capacity}};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->CommandBuffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(commands), commands);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  this->CullShader.use();
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->BladeBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->ChunkBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->InstanceBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->CommandBuffer);
+  glDispatchCompute(this->ChunkCount, 1, 1);
+  // the draws read the commands and the instances as vertex attributes
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GrassField::Draw(Shader *shader)
+{
+  shader->use();
+  if (shader->ID != this->DrawProgram)
+  {
+    this->setUniforms(shader->ID);
+    this->DrawProgram = shader->ID;
+  }
+  Grass::BindWind();
+  glActiveTexture(GL_TEXTURE0);
+  ResourceManager::GetTexture("t_grass").Bind();
+  glBindVertexArray(this->VAO);
+  if (this->GpuCulled)
+  {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->CommandBuffer);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void *)0);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void *)sizeof(DrawArraysIndirectCommand));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  else
+  {
+    if (this->DrawCounts[0] > 0)
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, Grass::BLADE_VERTICES, this->DrawCounts[0]);
+    glBindVertexArray(this->LodVAO);
+    if (this->DrawCounts[1] > 0)
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, Grass::BLADE_VERTICES, Grass::BLADE_LOD_VERTICES, this->DrawCounts[1]);
+  }
+  glBindVertexArray(0);
+}
+
+void GrassField::Release()
+{
+  glDeleteBuffers(1, &this->BladeBuffer);
+  glDeleteBuffers(1, &this->ChunkBuffer);
+  glDeleteBuffers(1, &this->InstanceBuffer);
+  glDeleteBuffers(1, &this->CommandBuffer);
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteVertexArrays(1, &this->LodVAO);
+  this->BladeBuffer = this->ChunkBuffer = this->InstanceBuffer = this->CommandBuffer = this->VAO = this->LodVAO = 0;
+}
+
+void GrassField::setUniforms(GLuint program) const
+{
+  glUniformMatrix4fv(glGetUniformLocation(program, "patchModels"), this->TransformCount, GL_FALSE, glm::value_ptr(this->Models[0]));
+  glUniform3fv(glGetUniformLocation(program, "patchNormals"), this->TransformCount, glm::value_ptr(this->Normals[0]));
+  glUniform3f(glGetUniformLocation(program, "lodDistances"), Grass::Lod.MidDistance, Grass::Lod.ThinDistance, Grass::Lod.MaxDistance);
+}
@@ -0,0 +1,101 @@
+#ifndef GRASS_FIELD_H
+#define GRASS_FIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include <learnopengl/shader.h>
+#include "grass.h"
+#include "culling.h"
+
+// Blades per chunk, one compute work group (local_size_x in grass_cull.cs)
+const int GRASS_CHUNK_SIZE = 256;
+// Size of the patchModels/patchNormals arrays in grass_cull.cs and
+// grass_instanced.vs: the number of distinct patch transforms
+const int MAX_GRASS_PATCHES = 16;
+
+// One blade in the std430 buffers of grass_cull.cs, the baked GrassBlade
+// constants plus the patch transform. Root.w is the rank in the blade buffer
+// and the fade in the culled instance buffer. Padding slots have a rank of 2
+// and are never drawn.
+struct GrassInstance
+{
+  glm::vec4 Root;     // root position in patch space, rank or fade
+  glm::vec4 Shape;    // as GrassBlade
+  glm::vec4 Phase;    // as GrassBlade
+  glm::vec4 Response; // GrassBlade::Response, patch transform
+};
+
+// Bounds of one chunk in world space. Min.w is unused, Max.w is the number
+// of blades in the chunk.
+struct GrassChunk
+{
+  glm::vec4 Min;
+  glm::vec4 Max;
+};
+
+// glDrawArraysIndirect command, filled by grass_cull.cs
+struct DrawArraysIndirectCommand
+{
+  GLuint Count;
+  GLuint InstanceCount;
+  GLuint First;
+  GLuint BaseInstance;
+};
+
+// All grass patches merged into one buffer: the blades live in fixed-size
+// spatial chunks, each blade refers to its patch transform in a small
+// uniform array, and the blade texture is bound once.
+//
+// With GL 4.3 the field is GPU-driven: every frame a compute pass tests the
+// chunks against the view frustum, thins and fades the blades of visible
+// chunks by distance like the instanced path (see GrassLod) and appends
+// the survivors to an instance buffer, one range per blade LOD. The two
+// ranges are drawn with glDrawArraysIndirect, so the CPU cost of grass is
+// a dispatch and two draws however many blades there are. Otherwise Cull
+// does the same per chunk on the CPU: chunks outside the frustum are
+// skipped, and of the others the blades the density at the chunk's nearest
+// point keeps are copied (on the GPU, glCopyBufferSubData) into the full
+// or mid detail range of the instance buffer by the chunk's distance. The
+// two ranges are drawn with one instanced draw each and grass_instanced.vs
+// (GRASS_BATCHED) fades the blades one by one.
+class GrassField
+{
+public:
+  GLuint BladeBuffer, ChunkBuffer, InstanceBuffer, VAO;
+  GLuint CommandBuffer; // GPU culled only
+  GLuint LodVAO;        // not GPU culled: the mid range instances
+  Shader CullShader; // grass_cull.cs, GPU culled only
+  bool GpuCulled;
+  int TransformCount; // distinct patch transforms
+  int ChunkCount;
+  int Capacity; // blade slots, GRASS_CHUNK_SIZE per chunk
+  int DrawCounts[2]; // not GPU culled: full detail and mid range instances of the last Cull
+
+  // Whether the context has compute shaders, storage buffers and indirect draws
+  static bool Supported();
+  // Splits the patches' blades into chunks of neighbouring blades and
+  // creates the buffers. The field is GPU culled when given a cull shader.
+  GrassField(Grass **patches, int count, Shader cullShader = Shader());
+  // Culls and LODs the blades into the instance buffer. GPU culled from
+  // FrameData, which must be up to date, otherwise against the frustum
+  void Cull(const Frustum &frustum, const glm::vec3 &viewPos);
+  // Draws the blades with grass_instanced.vs built with GRASS_GPU_CULLED,
+  // or with GRASS_BATCHED when not GPU culled
+  void Draw(Shader *shader);
+  // Deletes the GL objects
+  void Release();
+
+private:
+  glm::mat4 Models[MAX_GRASS_PATCHES];
+  glm::vec3 Normals[MAX_GRASS_PATCHES];
+  std::vector<GrassChunk> Chunks; // not GPU culled, for Cull
+  std::vector<float> Ranks;       // not GPU culled: rank of every blade slot, ascending within a chunk
+  GLuint DrawProgram; // the draw program setUniforms last ran for
+  // Uploads the patch transforms and LOD distances to a program in use.
+  // They never change, so once for the cull program and each draw program.
+  void setUniforms(GLuint program) const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#version 330 core
+layout (location = 0) in vec2 aBlade; // (side, height) on the unit blade strip
+layout (location = 1) in vec4 aRoot;  // per blade: root position, seed (rank or fade when merged)
+layout (location = 2) in vec4 aShape; // per blade: height, half width, random wind direction
+layout (location = 3) in vec4 aPhase; // per blade: wind phase of the root, see Grass::MakeBlade
+layout (location = 4) in vec4 aResponse; // per blade: wind response and sway, patch when merged
+
+out BLADE_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+	vec2 TexCoord;
+	float Fade;
+} vs_out;
+
+#include "frame_data.glsl"
+#if defined(GRASS_GPU_CULLED) || defined(GRASS_BATCHED)
+// transforms of the patches, indexed by the blades (MAX_GRASS_PATCHES)
+uniform mat4 patchModels[16];
+uniform vec3 patchNormals[16];
+#else
+uniform mat4 model;
+uniform vec3 bladeNormal;
+#endif
+#ifdef GRASS_WIND_FIELD
+// simulated wind over the area, see WindField
+uniform sampler2D windField;
+uniform vec4 windFieldArea; // xz origin, 1 / extent
+#else
+// time dependent wind terms shared by all blades, see Grass::UpdateWind
+uniform vec4 windTerms;
+#endif
+uniform vec2 windSway;
+#ifndef GRASS_GPU_CULLED
+// mid, thin and max distance of the level of detail, see GrassLod
+uniform vec3 lodDistances;
+// blades in the whole patch, of which the draw covers a prefix
+uniform int bladeCount;
+
+// fraction of the blades drawn at a distance, mirrors Grass::Density
+float Density(float dist)
+{
+    float density = 1.0;
+    if (dist > lodDistances.y)
+        density = pow(lodDistances.y / dist, 2.0);
+    return density * clamp((lodDistances.z - dist) / (0.2 * lodDistances.z), 0.0, 1.0);
+}
+#endif
+
+void main()
+{
+#if defined(GRASS_GPU_CULLED) || defined(GRASS_BATCHED)
+    int patchIndex = int(aResponse.w);
+    mat4 model = patchModels[patchIndex];
+    vec3 normal = patchNormals[patchIndex];
+#else
+    vec3 normal = bladeNormal;
+#endif
+    vec3 worldRoot = vec3(model * vec4(aRoot.xyz, 1.0));
+#ifdef GRASS_GPU_CULLED
+    // grass_cull.cs already dropped, thinned and faded the blades
+    vs_out.Fade = aRoot.w;
+#else
+    // blades are stored in random order: the ones ranked past the density
+    // at their own distance fade out over another quarter of it
+    float density = Density(distance(worldRoot, viewPos));
+#ifdef GRASS_BATCHED
+    float rank = aRoot.w;
+#else
+    float rank = (float(gl_InstanceID) + 0.5) / float(bladeCount);
+#endif
+    vs_out.Fade = clamp((1.25 * density - rank) / (0.25 * density + 1e-4), 0.0, 1.0);
+    if (vs_out.Fade <= 0.0)
+    {
+        // outside the clip volume, the whole strip is culled
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+#endif
+
+    float height = aShape.x;
+    float width = aShape.y;
+
+#ifdef GRASS_WIND_FIELD
+    // one fetch of the simulated wind at the root
+    vec2 wind = texture(windField, (worldRoot.xz - windFieldArea.xy) * windFieldArea.zw).rg;
+#else
+    // wind, the same field grass.gs bends its blades with: the shared terms
+    // of the frame combined with the blade's baked phases and response
+    vec2 wind = vec2(windTerms.x);
+    wind.x += 0.5 * (windTerms.y * aPhase.x + windTerms.z * aPhase.y);
+    wind.y += windTerms.z * aPhase.z - windTerms.y * aPhase.w;
+#endif
+    wind *= dot(aResponse.xyz, vec3(1.0, windSway));
+    wind += aShape.zw;
+    float windForce = length(wind);
+
+    // the tip bends quadratically with the height along the blade
+    float curve = aBlade.y * aBlade.y;
+    vec4 pos = vec4(aRoot.xyz + vec3((aBlade.x * 2.0 - 1.0) * width, aBlade.y * height, 0.0), 1.0);
+    pos.xz += 0.5 * wind * curve;
+    pos.y -= 0.4 * windForce * curve;
+
+    gl_Position = projection * view * model * pos;
+    vs_out.FragPos = vec3(model * pos);
+    vs_out.Normal = normal;
+    vs_out.TexCoord = aBlade;
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "grass_scatter.h"
+#include "util.h"
+#include "height_pyramid.h"
+
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include <stb_image.h>
+
+namespace
+{
+  // Tries around every active sample before it is retired (Bridson's k)
+  const int CANDIDATES = 30;
+
+  // Grayscale image, sampled bilinearly in [0, 1]
+  struct GreyImage
+  {
+    int Width, Height;
+    std::vector<unsigned char> Texels;
+
+    bool Load(const std::string &file)
+    {
+      unsigned char *image = stbi_load(file.c_str(), &this->Width, &this->Height, 0, STBI_grey);
+      if (!image)
+      {
+        std::cout << "ERROR::GRASS_SCATTER: Failed to load " << file << std::endl;
+        return false;
+      }
+      this->Texels.assign(image, image + this->Width * this->Height);
+      stbi_image_free(image);
+      return true;
+    }
+
+    // x and y in texels
+    float Sample(float x, float y) const
+    {
+      x = glm::clamp(x, 0.0f, this->Width - 1.0f);
+      y = glm::clamp(y, 0.0f, this->Height - 1.0f);
+      int x0 = (int)x, y0 = (int)y;
+      int x1 = std::min(x0 + 1, this->Width - 1), y1 = std::min(y0 + 1, this->Height - 1);
+      float fx = x - x0, fy = y - y0;
+      float top = glm::mix((float)this->Texels[x0 + y0 * this->Width], (float)this->Texels[x1 + y0 * this->Width], fx);
+      float bottom = glm::mix((float)this->Texels[x0 + y1 * this->Width], (float)this->Texels[x1 + y1 * this->Width], fx);
+      return glm::mix(top, bottom, fy) / 255.0f;
+    }
+  };
+
+  // Background grid of the Poisson disk, cells are small enough to hold one
+  // sample each. Chunks only write the cells inside them.
+  struct SampleGrid
+  {
+    glm::vec2 Origin;
+    float Cell, Radius;
+    int Width, Height;
+    std::vector<glm::vec2> Samples;
+    std::vector<unsigned char> Used; // not vector<bool>, chunks write it concurrently
+
+    SampleGrid(glm::vec2 origin, glm::vec2 extent, float radius)
+      : Origin(origin), Cell(radius / std::sqrt(2.0f)), Radius(radius)
+    {
+      this->Width = (int)std::ceil(extent.x / this->Cell) + 1;
+      this->Height = (int)std::ceil(extent.y / this->Cell) + 1;
+      this->Samples.resize(this->Width * this->Height);
+      this->Used.resize(this->Width * this->Height, 0);
+    }
+
+    // Whether no sample lies within Radius of p
+    bool Free(glm::vec2 p) const
+    {
+      int cx = (int)((p.x - this->Origin.x) / this->Cell);
+      int cy = (int)((p.y - this->Origin.y) / this->Cell);
+      for (int y = std::max(cy - 2, 0); y <= std::min(cy + 2, this->Height - 1); y++)
+        for (int x = std::max(cx - 2, 0); x <= std::min(cx + 2, this->Width - 1); x++)
+        {
+          int cell = x + y * this->Width;
+          if (this->Used[cell] && glm::distance(this->Samples[cell], p) < this->Radius)
+            return false;
+        }
+      return true;
+    }
+
+    void Insert(glm::vec2 p)
+    {
+      int cell = (int)((p.x - this->Origin.x) / this->Cell) + (int)((p.y - this->Origin.y) / this->Cell) * this->Width;
+      this->Samples[cell] = p;
+      this->Used[cell] = 1;
+    }
+  };
+
+  // Bridson's algorithm inside one chunk, restarted from random darts until
+  // they stop landing, which also fills the gaps along the chunk borders
+  void scatterChunk(GrassScatterChunk &chunk, SampleGrid &grid, const GrassScatterDesc &desc, glm::vec2 lo, glm::vec2 hi,
+                    const GreyImage &density, const HeightPyramid &heights)
+  {
+    std::mt19937 rng(desc.Seed ^ (chunk.X * 73856093u) ^ (chunk.Z * 19349663u));
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::vec2> points, active;
+    for (int dart = 0; dart < CANDIDATES; dart++)
+    {
+      glm::vec2 p = lo + (hi - lo) * glm::vec2(unit(rng), unit(rng));
+      if (!grid.Free(p))
+        continue;
+      grid.Insert(p);
+      points.push_back(p);
+      active.push_back(p);
+      while (!active.empty())
+      {
+        size_t index = rng() % active.size();
+        glm::vec2 center = active[index];
+        bool found = false;
+        for (int k = 0; k < CANDIDATES && !found; k++)
+        {
+          // uniformly in the annulus between Radius and 2 * Radius
+          float angle = 6.2831853f * unit(rng);
+          float radius = grid.Radius * (1.0f + unit(rng));
+          glm::vec2 candidate = center + radius * glm::vec2(std::cos(angle), std::sin(angle));
+          if (candidate.x < lo.x || candidate.y < lo.y || candidate.x >= hi.x || candidate.y >= hi.y || !grid.Free(candidate))
+            continue;
+          grid.Insert(candidate);
+          points.push_back(candidate);
+          active.push_back(candidate);
+          found = true;
+        }
+        if (!found)
+        {
+          active[index] = active.back();
+          active.pop_back();
+        }
+      }
+    }
+
+    // thin the full density disk by the mask and lift the blades onto the terrain
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      glm::vec2 texel = (points[i] - glm::vec2(desc.TerrainPosition.x, desc.TerrainPosition.z)) / glm::vec2(desc.TerrainScale.x, desc.TerrainScale.z);
+      glm::vec2 uv = texel / glm::vec2((float)heights.Width, (float)heights.Height);
+      if (unit(rng) >= density.Sample(uv.x * density.Width, uv.y * density.Height))
+        continue;
+      // on the triangles the terrain is drawn with
+      glm::vec3 root(points[i].x, heights.HeightAt(points[i].x, points[i].y), points[i].y);
+      chunk.Bounds.Extend(root);
+      chunk.Blades.push_back(Grass::MakeBlade(root, unit(rng)));
+    }
+  }
+}
+
+std::vector<GrassScatterChunk> GrassScatter::Generate(const GrassScatterDesc &desc)
+{
+  std::vector<GrassScatterChunk> result;
+  GreyImage density;
+  if (!density.Load(desc.DensityMap))
+    return result;
+  HeightPyramid heights(desc.HeightMap.c_str(), desc.TerrainPosition, desc.TerrainScale);
+  if (!heights.Valid())
+    return result;
+
+  // the terrain covers one heightmap texel per TerrainScale
+  glm::vec2 origin(desc.TerrainPosition.x, desc.TerrainPosition.z);
+  glm::vec2 extent = glm::vec2(heights.Width - 1.0f, heights.Height - 1.0f) * glm::vec2(desc.TerrainScale.x, desc.TerrainScale.z);
+  SampleGrid grid(origin, extent, desc.Spacing);
+  // Free reads two cells around the sample's cell, up to three cells past a
+  // chunk's edge. Chunks of one phase are a chunk apart, so with chunks of
+  // at least three cells none reads the cells another one writes meanwhile.
+  float chunkSize = std::max(desc.ChunkSize, 3.0f * grid.Cell);
+  int columns = (int)std::ceil(extent.x / chunkSize);
+  int rows = (int)std::ceil(extent.y / chunkSize);
+
+  std::vector<GrassScatterChunk> chunks(columns * rows);
+  for (int z = 0; z < rows; z++)
+    for (int x = 0; x < columns; x++)
+    {
+      chunks[x + z * columns].X = x;
+      chunks[x + z * columns].Z = z;
+    }
+
+  // chunks of one checkerboard colour are never neighbours, so they run in parallel
+  for (int phase = 0; phase < 4; phase++)
+  {
+    std::vector<int> batch;
+    for (size_t i = 0; i < chunks.size(); i++)
+      if ((chunks[i].X % 2) + 2 * (chunks[i].Z % 2) == phase)
+        batch.push_back(i);
+    parallel_for(batch.size(), [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+        GrassScatterChunk &chunk = chunks[batch[i]];
+        glm::vec2 lo = origin + glm::vec2((float)chunk.X, (float)chunk.Z) * chunkSize;
+        glm::vec2 hi = glm::min(lo + glm::vec2(chunkSize), origin + extent);
+        scatterChunk(chunk, grid, desc, lo, hi, density, heights);
+      }
+    });
+  }
+
+  for (size_t i = 0; i < chunks.size(); i++)
+    if (!chunks[i].Blades.empty())
+      result.push_back(chunks[i]);
+  return result;
+}
+
+Grass *GrassScatter::CreatePatch(const GrassScatterChunk &chunk, const GrassScatterDesc &desc, glm::vec3 scale)
+{
+  // rebaked, the wind phases depend on the root in patch space
+  std::vector<GrassBlade> blades;
+  blades.reserve(chunk.Blades.size());
+  for (size_t i = 0; i < chunk.Blades.size(); i++)
+    blades.push_back(Grass::MakeBlade((chunk.Blades[i].Root - desc.TerrainPosition) / scale, chunk.Blades[i].Seed));
+  return new Grass(desc.TerrainPosition, scale, glm::vec3(1.0f), blades, desc.Spacing / scale.x);
+}
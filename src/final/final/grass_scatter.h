@@ -0,0 +1,53 @@
+#ifndef GRASS_SCATTER_H
+#define GRASS_SCATTER_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "grass.h"
+#include "culling.h"
+
+// Where and how densely grass is scattered over a heightmap terrain
+struct GrassScatterDesc
+{
+  std::string DensityMap;  // grayscale mask over the terrain, white is full density
+  std::string HeightMap;   // grayscale heightmap, as drawn by Plane
+  glm::vec3 TerrainPosition; // Plane position and scale of the heightmap
+  glm::vec3 TerrainScale;
+  float Spacing;           // minimum distance between blades at full density
+  float ChunkSize;         // side of a chunk, raised to 3 / sqrt(2) * Spacing (about 2.2 * Spacing) if smaller
+  unsigned int Seed;
+};
+
+// Blades of one square chunk of the terrain, roots in world space
+struct GrassScatterChunk
+{
+  int X, Z; // chunk coordinates
+  AABB Bounds; // of the roots
+  std::vector<GrassBlade> Blades;
+};
+
+// Scatters grass blades over a terrain from a painted density mask. Blade
+// positions are Poisson disk (blue noise) samples generated with Bridson's
+// algorithm chunk by chunk, thinned by the mask and lifted onto the
+// heightmap. Chunks are generated in parallel in four passes over a 2x2
+// checkerboard, so no two chunks that run at the same time are neighbours
+// and each can reject samples near the finished chunks around it without
+// locking. Chunks own their blades and become one Grass patch each, so they
+// are culled and can be created and released independently.
+class GrassScatter
+{
+public:
+  // Generates the non-empty chunks, an empty list if an image fails to load
+  static std::vector<GrassScatterChunk> Generate(const GrassScatterDesc &desc);
+  // Creates the patch drawing one chunk with the given blade scale. All
+  // patches of a terrain share the terrain position as their transform.
+  static Grass *CreatePatch(const GrassScatterChunk &chunk, const GrassScatterDesc &desc, glm::vec3 scale);
+
+private:
+  GrassScatter() {}
+};
+
+#endif
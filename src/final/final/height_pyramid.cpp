@@ -0,0 +1,263 @@
+#include "height_pyramid.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "util.h"
+
+namespace
+{
+  // batches at least this large are split over threads
+  const size_t PARALLEL_BATCH = 4096;
+
+  // Moeller-Trumbore, the distance along the ray if it crosses the triangle
+  bool triangleHit(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &a, const glm::vec3 &b,
+                   const glm::vec3 &c, float &distance)
+  {
+    // rays along a shared edge hit one of its triangles despite rounding
+    const float EDGE = -1e-6f;
+    glm::vec3 e1 = b - a, e2 = c - a;
+    glm::vec3 p = glm::cross(direction, e2);
+    float det = glm::dot(e1, p);
+    if (std::fabs(det) < 1e-12f)
+      return false;
+    float inverse = 1.0f / det;
+    glm::vec3 s = origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < EDGE || u > 1.0f - EDGE)
+      return false;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < EDGE || u + v > 1.0f - EDGE)
+      return false;
+    distance = glm::dot(e2, q) * inverse;
+    return distance >= 0.0f;
+  }
+}
+
+HeightPyramid::HeightPyramid(const char *file, glm::vec3 position, glm::vec3 size)
+  : Position(position), Size(size), Width(0), Height(0), Levels(0)
+{
+  int width, height;
+  unsigned char *image = stbi_load(file, &width, &height, 0, STBI_grey);
+  if (!image)
+  {
+    std::cout << "ERROR::HEIGHT_PYRAMID: Failed to load heightmap " << file << std::endl;
+    return;
+  }
+  this->build(image, width, height);
+  stbi_image_free(image);
+}
+
+HeightPyramid::HeightPyramid(const unsigned char *heights, int width, int height, glm::vec3 position, glm::vec3 size)
+  : Position(position), Size(size), Width(0), Height(0), Levels(0)
+{
+  this->build(heights, width, height);
+}
+
+void HeightPyramid::build(const unsigned char *heights, int width, int height)
+{
+  if (width < 2 || height < 2)
+  {
+    std::cout << "ERROR::HEIGHT_PYRAMID: A heightmap needs at least 2x2 texels" << std::endl;
+    return;
+  }
+  this->Width = width;
+  this->Height = height;
+  this->Data.assign(heights, heights + (size_t)width * height);
+
+  // level 0, the quads between the texels
+  Level &base = this->LevelData[0];
+  base.Columns = width - 1;
+  base.Rows = height - 1;
+  base.Heights.resize(2 * (size_t)base.Columns * base.Rows);
+  parallel_for(base.Rows, [&](int begin, int end) {
+    for (int z = begin; z < end; z++)
+      for (int x = 0; x < base.Columns; x++)
+      {
+        const unsigned char *row = &this->Data[x + (size_t)z * width];
+        unsigned char a = row[0], b = row[1], c = row[width], d = row[width + 1];
+        unsigned char *cell = &base.Heights[2 * (x + (size_t)z * base.Columns)];
+        cell[0] = std::min(std::min(a, b), std::min(c, d));
+        cell[1] = std::max(std::max(a, b), std::max(c, d));
+      }
+  });
+  this->Levels = 1;
+
+  // halve until a single cell covers the heightmap
+  while ((this->LevelData[this->Levels - 1].Columns > 1 || this->LevelData[this->Levels - 1].Rows > 1) &&
+         this->Levels < HEIGHT_PYRAMID_MAX_LEVELS)
+  {
+    const Level &below = this->LevelData[this->Levels - 1];
+    Level &level = this->LevelData[this->Levels];
+    level.Columns = (below.Columns + 1) / 2;
+    level.Rows = (below.Rows + 1) / 2;
+    level.Heights.resize(2 * (size_t)level.Columns * level.Rows);
+    for (int z = 0; z < level.Rows; z++)
+      for (int x = 0; x < level.Columns; x++)
+      {
+        unsigned char low = 255, high = 0;
+        for (int j = 2 * z; j < std::min(2 * z + 2, below.Rows); j++)
+          for (int i = 2 * x; i < std::min(2 * x + 2, below.Columns); i++)
+          {
+            const unsigned char *child = &below.Heights[2 * (i + (size_t)j * below.Columns)];
+            low = std::min(low, child[0]);
+            high = std::max(high, child[1]);
+          }
+        level.Heights[2 * (x + (size_t)z * level.Columns)] = low;
+        level.Heights[2 * (x + (size_t)z * level.Columns) + 1] = high;
+      }
+    this->Levels++;
+  }
+}
+
+glm::ivec2 HeightPyramid::CellCount(int level) const
+{
+  const Level &data = this->LevelData[std::min(level, this->Levels - 1)];
+  return glm::ivec2(data.Columns, data.Rows);
+}
+
+const unsigned char *HeightPyramid::CellHeights(int level) const
+{
+  return &this->LevelData[std::min(level, this->Levels - 1)].Heights[0];
+}
+
+// Height in texel units on the triangles of the quad under a texel position
+float HeightPyramid::localHeight(float x, float z) const
+{
+  x = std::min(std::max(x, 0.0f), this->Width - 1.0f);
+  z = std::min(std::max(z, 0.0f), this->Height - 1.0f);
+  int k = std::min((int)x, this->Width - 2), i = std::min((int)z, this->Height - 2);
+  float fx = x - k, fz = z - i;
+  float h00 = this->texel(k, i), h11 = this->texel(k + 1, i + 1);
+  // Plane splits the quad from (k, i) to (k + 1, i + 1)
+  if (fx >= fz)
+    return h00 + fx * (this->texel(k + 1, i) - h00) + fz * (h11 - this->texel(k + 1, i));
+  return h00 + fz * (this->texel(k, i + 1) - h00) + fx * (h11 - this->texel(k, i + 1));
+}
+
+float HeightPyramid::HeightAt(float x, float z) const
+{
+  if (!this->Valid())
+    return this->Position.y;
+  float height = this->localHeight((x - this->Position.x) / this->Size.x, (z - this->Position.z) / this->Size.z);
+  return this->Position.y + height * this->Size.y;
+}
+
+void HeightPyramid::HeightsAt(const glm::vec2 *points, float *heights, size_t count) const
+{
+  std::function<void(int, int)> body = [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      heights[i] = this->HeightAt(points[i].x, points[i].y);
+  };
+  if (count >= PARALLEL_BATCH)
+    parallel_for((int)count, body);
+  else
+    body(0, (int)count);
+}
+
+bool HeightPyramid::quadHit(int x, int z, const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const
+{
+  glm::vec3 v00((float)x, this->texel(x, z), (float)z), v11((float)(x + 1), this->texel(x + 1, z + 1), (float)(z + 1));
+  glm::vec3 v01((float)x, this->texel(x, z + 1), (float)(z + 1)), v10((float)(x + 1), this->texel(x + 1, z), (float)z);
+  float first, second;
+  bool a = triangleHit(origin, direction, v00, v01, v11, first);
+  bool b = triangleHit(origin, direction, v00, v11, v10, second);
+  if (a && b)
+    distance = std::min(first, second);
+  else if (a || b)
+    distance = a ? first : second;
+  return a || b;
+}
+
+bool HeightPyramid::Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) const
+{
+  if (!this->Valid())
+    return false;
+  // in texel units the ray keeps its parameter
+  glm::vec3 o = (origin - this->Position) / this->Size;
+  glm::vec3 d = direction / this->Size;
+  glm::vec3 inverse;
+  for (int i = 0; i < 3; i++)
+    inverse[i] = std::fabs(d[i]) > 1e-20f ? 1.0f / d[i] : (d[i] < 0.0f ? -1e30f : 1e30f);
+  // children nearer along the ray are visited first
+  int nearX = d.x < 0.0f ? 1 : 0, nearZ = d.z < 0.0f ? 1 : 0;
+
+  struct Cell
+  {
+    int Level, X, Z;
+  };
+  // each descent replaces one cell by four
+  Cell stack[3 * HEIGHT_PYRAMID_MAX_LEVELS + 4];
+  int top = 0;
+  const Level &root = this->LevelData[this->Levels - 1];
+  for (int z = 0; z < root.Rows; z++)
+    for (int x = 0; x < root.Columns; x++)
+    {
+      Cell cell = {this->Levels - 1, x, z};
+      stack[top++] = cell;
+    }
+
+  float best = maxDistance;
+  bool hit = false;
+  while (top > 0)
+  {
+    Cell cell = stack[--top];
+    const Level &level = this->LevelData[cell.Level];
+    const unsigned char *range = &level.Heights[2 * (cell.X + (size_t)cell.Z * level.Columns)];
+    glm::vec3 low((float)(cell.X << cell.Level), (float)range[0], (float)(cell.Z << cell.Level));
+    glm::vec3 high((float)std::min((cell.X + 1) << cell.Level, this->Width - 1), (float)range[1],
+                   (float)std::min((cell.Z + 1) << cell.Level, this->Height - 1));
+    // slab test, cells entered beyond the nearest hit so far are skipped
+    glm::vec3 t0 = (low - o) * inverse, t1 = (high - o) * inverse;
+    float enter = std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)), std::max(std::min(t0.z, t1.z), 0.0f));
+    float exit = std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)), std::min(std::max(t0.z, t1.z), best));
+    if (enter > exit)
+      continue;
+
+    if (cell.Level == 0)
+    {
+      float t;
+      if (this->quadHit(cell.X, cell.Z, o, d, t) && t <= best)
+      {
+        best = t;
+        hit = true;
+      }
+      continue;
+    }
+    // push the children far to near so the nearest is popped first
+    const Level &below = this->LevelData[cell.Level - 1];
+    const int order[4][2] = {{1 - nearX, 1 - nearZ}, {1 - nearX, nearZ}, {nearX, 1 - nearZ}, {nearX, nearZ}};
+    for (int i = 0; i < 4; i++)
+    {
+      Cell child = {cell.Level - 1, 2 * cell.X + order[i][0], 2 * cell.Z + order[i][1]};
+      if (child.X < below.Columns && child.Z < below.Rows)
+        stack[top++] = child;
+    }
+  }
+  if (hit)
+    distance = best;
+  return hit;
+}
+
+void HeightPyramid::Raycasts(const HeightRay *rays, HeightHit *hits, size_t count) const
+{
+  std::function<void(int, int)> body = [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+    {
+      HeightHit &hit = hits[i];
+      hit.Hit = this->Raycast(rays[i].Origin, rays[i].Direction, rays[i].MaxDistance, hit.Distance);
+      if (!hit.Hit)
+        hit.Distance = rays[i].MaxDistance;
+      hit.Position = rays[i].Origin + rays[i].Direction * hit.Distance;
+    }
+  };
+  if (count >= PARALLEL_BATCH)
+    parallel_for((int)count, body);
+  else
+    body(0, (int)count);
+}
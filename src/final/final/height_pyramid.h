@@ -0,0 +1,86 @@
+#ifndef HEIGHT_PYRAMID_H
+#define HEIGHT_PYRAMID_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Levels of the pyramid at most, enough for a 2^24 texel wide heightmap
+const int HEIGHT_PYRAMID_MAX_LEVELS = 24;
+
+// A ray for HeightPyramid::Raycast, in world space. Direction need not be
+// normalized, distances are in multiples of it.
+struct HeightRay
+{
+  glm::vec3 Origin;
+  glm::vec3 Direction;
+  float MaxDistance;
+};
+
+struct HeightHit
+{
+  bool Hit;
+  float Distance;    // along the ray, in multiples of its direction
+  glm::vec3 Position;
+};
+
+// Height queries and raycasts against a heightmap terrain, exactly on the
+// triangles Plane draws from it (one texel per unit scaled by the terrain
+// size, the 8-bit value as height, quads split along the same diagonal).
+//
+// Level 0 holds the min and max texel of every quad of the grid, each
+// level above the min and max of 2x2 cells of the one below, up to a single
+// cell, so a cell of level L holds the range of a square of 2^L quads. A
+// ray walks the pyramid front to back and only descends into cells
+// whose height range it crosses, so it skips the empty space above the
+// terrain in large steps and tests a handful of triangles. The pyramid is
+// immutable once built, so all queries can run from any number of threads.
+// Terrain and TessellatedTerrain take the height ranges of their nodes and
+// patches from it as well.
+class HeightPyramid
+{
+public:
+  glm::vec3 Position, Size; // the terrain's transform, as Plane and Terrain use it
+  int Width, Height;        // of the heightmap, in texels
+  int Levels;
+
+  // Loads a grayscale heightmap, the pyramid is empty if that fails
+  HeightPyramid(const char *file, glm::vec3 position, glm::vec3 size);
+  // Builds the pyramid of heightmap texels, row by row
+  HeightPyramid(const unsigned char *heights, int width, int height, glm::vec3 position, glm::vec3 size);
+  bool Valid() const { return this->Levels > 0; }
+
+  // World height of the surface at a world xz position, clamped to the edges
+  float HeightAt(float x, float z) const;
+  // HeightAt of many xz positions, split over threads for large batches
+  void HeightsAt(const glm::vec2 *points, float *heights, size_t count) const;
+  // First hit of a ray with the surface within its max distance
+  bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &distance) const;
+  // Raycast of many rays, split over threads for large batches
+  void Raycasts(const HeightRay *rays, HeightHit *hits, size_t count) const;
+
+  // The heightmap texels, row by row
+  const unsigned char *Texels() const { return &this->Data[0]; }
+  // Cells per row and column of a level. Levels above the top one are its
+  // single cell, so callers can ask for any power of two square.
+  glm::ivec2 CellCount(int level) const;
+  // Min and max heights of the cells of a level, row by row, clamped like CellCount
+  const unsigned char *CellHeights(int level) const;
+
+private:
+  struct Level
+  {
+    int Columns, Rows;
+    std::vector<unsigned char> Heights; // min, max per cell, row by row, texel values like the heightmap
+  };
+  std::vector<unsigned char> Data;
+  Level LevelData[HEIGHT_PYRAMID_MAX_LEVELS];
+
+  void build(const unsigned char *heights, int width, int height);
+  float texel(int x, int z) const { return (float)this->Data[x + (size_t)z * this->Width]; }
+  float localHeight(float x, float z) const;
+  bool quadHit(int x, int z, const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const;
+};
+
+#endif
@@ -8,7 +8,6 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
-#include <learnopengl/model.h>
 
 #include "wood.h"
 #include "skybox.h"
@@ -16,13 +15,24 @@
 #include "grass.h"
 #include "resource_manager.h"
 #include "fluid.h"
+#include "shader_cache.h"
+#include "frame_uniforms.h"
+#include "model_cache.h"
+#include "culling.h"
+#include "shadow_cascades.h"
+#include "grass_field.h"
+#include "grass_scatter.h"
+#include "wind_field.h"
+#include "terrain.h"
+#include "terrain_tiles.h"
+#include "height_pyramid.h"
+#include "terrain_tess.h"
+#include "splat_texture.h"
+#include "text_atlas.h"
 #include <iostream>
+#include <fstream>
 #include <direct.h>
 
-// FreeType
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
@@ -39,23 +49,77 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// GPU memory budget for textures owned by the ResourceManager
+const size_t TEXTURE_BUDGET = 256 * 1024 * 1024;
+
+// cascaded shadow maps of the sun, 3 x 2048^2 24 bit depth layers, or
+// 3 x 1024^2 blurred moment layers in SHADOW_EVSM mode
+const int SHADOW_CASCADES = 3;
+const ShadowMode SHADOW_MODE = SHADOW_PCF;
+const int SHADOW_RESOLUTION = SHADOW_MODE == SHADOW_EVSM ? 1024 : 2048;
+// camera distance up to which shadows are drawn
+const float SHADOW_DISTANCE = 150.0f;
+// PCF filter variant compiled into the lighting shaders: 1, 4, 9 or 16 (Poisson) taps
+const int SHADOW_KERNEL = 4;
+// draw grass blades as instances of one strip instead of expanding points in grass.gs
+const bool GRASS_INSTANCED = true;
+// cull and LOD the instanced grass in a compute pass and draw it indirectly, where GL 4.3 is available
+const bool GRASS_GPU_CULLING = true;
+// scatter grass over the terrain by its mask
+const bool GRASS_SCATTER = false;
+const float GRASS_SCATTER_SPACING = 0.8f, GRASS_SCATTER_CHUNK = 16.0f;
+// grass level of detail: reduced blades, thinning and cutoff distances
+const GrassLod GRASS_LOD = {30.0f, 50.0f, 150.0f};
+// sway grass in a simulated wind field with travelling gusts instead of the analytic wind
+const bool GRASS_WIND_FIELD = true;
+const glm::vec2 GRASS_WIND_MEAN(1.0f, 0.6f);
+// draw the terrain, the flags below choose how
+const bool TERRAIN = true;
+// draw the terrain as a CDLOD quadtree instead of one full resolution Plane
+const bool TERRAIN_CDLOD = true;
+// distance up to which the finest terrain level is drawn, doubling per level
+const float TERRAIN_LOD_DISTANCE = 80.0f;
+// stream the CDLOD terrain from a memory-mapped tile file, baked from the heightmap on first run
+const bool TERRAIN_STREAMED = false;
+// heightmap tiles kept on the GPU at once
+const int TERRAIN_TILE_SLOTS = 256;
+// bake the terrain's texture layers and mask into a virtual texture instead of blending them per pixel
+const bool TERRAIN_SPLAT = true;
+// virtual texels per side of the baked splat, and atlas pages per side (of 128^2 texels each)
+const int TERRAIN_SPLAT_SIZE = 8192, TERRAIN_SPLAT_ATLAS = 16;
+// draw the terrain and the lake as tessellated patches where GL 4.0 is available
+const bool TESSELLATION = true;
+// wanted edge length of the tessellated triangles, in pixels
+const float TESS_TRIANGLE_SIZE = 8.0f;
+// height the camera keeps above the terrain, 0 to fly through it
+const float CAMERA_GROUND_CLEARANCE = 1.8f;
+// multisampling of the default framebuffer, distant grass fades out through alpha to coverage
+const int MSAA_SAMPLES = 4;
+const float CAMERA_NEAR = 0.1f, CAMERA_FAR = 200.0f;
+
+// kinds of objects in the scene BVH
+enum SceneKind
+{
+  SCENE_MODEL_MESH,
+  SCENE_GRASS,
+  SCENE_WATER,
+  SCENE_KIND_COUNT
+};
+// F1 toggles the culling statistics
+bool showStats = false;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 // 文字显示-----
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character {
-	GLuint TextureID;   // ID handle of the glyph texture
-	glm::ivec2 Size;    // Size of glyph
-	glm::ivec2 Bearing;  // Offset from baseline to left/top of glyph
-	GLuint Advance;    // Horizontal offset to advance to next glyph
-};
-
-std::map<GLchar, Character> Characters;
-GLuint textVAO, textVBO;
+// every glyph in one texture, the HUD strings of a frame in one vertex buffer
+GlyphAtlas glyphAtlas;
+TextBatch *textBatch = NULL;
 
-void RenderText(Shader &shader, std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color);
+// Queues a string for the next RenderText, which draws all queued strings with a single call
+void QueueText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color);
+void RenderText(Shader &shader);
 //文字显示-----
 
 int main(int argc, char *argv[])
@@ -67,6 +131,7 @@ int main(int argc, char *argv[])
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  glfwWindowHint(GLFW_SAMPLES, MSAA_SAMPLES);
 
   GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "final", nullptr, nullptr);
   if (window == NULL)
@@ -94,88 +159,24 @@ int main(int argc, char *argv[])
   // OpenGL configuration
 
   glEnable(GL_DEPTH_TEST);
+  ResourceManager::SetMemoryBudget(TEXTURE_BUDGET);
+  FrameUniforms::Init();
   
   //文字显示-----
   //glEnable(GL_CULL_FACE);
   glEnable(GL_BLEND);
-  //glEnable(GL_MULTISAMPLE);
+  glEnable(GL_MULTISAMPLE);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  // Compile and setup the shader
-  Shader textshader(FileSystem::getPath("src/final/final/text.vs").c_str(), FileSystem::getPath("src/final/final/text.fs").c_str());
+  // Compile and setup the shader, program binaries are cached between runs
+  ShaderCache::Directory = FileSystem::getPath("bin/shader_cache");
+  Shader textshader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/text.vs").c_str(), FileSystem::getPath("src/final/final/text.fs").c_str(), nullptr, "text");
   glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(SCR_WIDTH), 0.0f, static_cast<GLfloat>(SCR_HEIGHT));
   textshader.use();
   glUniformMatrix4fv(glGetUniformLocation(textshader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-  // FreeType
-  FT_Library ft;
-  // All functions return a value different than 0 whenever an error occurred
-  if (FT_Init_FreeType(&ft))
-	  std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-
-  // Load font as face
-  FT_Face face;
-  if (FT_New_Face(ft, FileSystem::getPath("fonts/consolab.ttf").c_str(), 0, &face))
-	  std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
-
-  // Set size to load glyphs as
-  FT_Set_Pixel_Sizes(face, 0, 48);
-
-  // Disable byte-alignment restriction
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-
-  // Load first 128 characters of ASCII set
-  for (GLubyte c = 0; c < 128; c++) {
-	  // Load character glyph 
-	  if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-		  std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-		  continue;
-	  }
-	  // Generate texture
-	  GLuint texture;
-	  glGenTextures(1, &texture);
-	  glBindTexture(GL_TEXTURE_2D, texture);
-	  glTexImage2D(
-		  GL_TEXTURE_2D,
-		  0,
-		  GL_RED,
-		  face->glyph->bitmap.width,
-		  face->glyph->bitmap.rows,
-		  0,
-		  GL_RED,
-		  GL_UNSIGNED_BYTE,
-		  face->glyph->bitmap.buffer
-	  );
-	  // Set texture options
-	  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	  // Now store character for later use
-	  Character character = {
-		  texture,
-		  glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-		  glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-		  face->glyph->advance.x
-	  };
-	  Characters.insert(std::pair<GLchar, Character>(c, character));
-  }
-  glBindTexture(GL_TEXTURE_2D, 0);
-  // Destroy FreeType once we're finished
-  FT_Done_Face(face);
-  FT_Done_FreeType(ft);
-
-
-  // Configure textVAO/textVBO for texture quads
-  glGenVertexArrays(1, &textVAO);
-  glGenBuffers(1, &textVBO);
-  glBindVertexArray(textVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  // Glyphs rendered with FreeType and packed into one atlas texture, no text is drawn without them
+  if (glyphAtlas.Load(FileSystem::getPath("fonts/consolab.ttf").c_str(), 48))
+    textBatch = new TextBatch(&glyphAtlas);
 
 
   //文字显示-----
@@ -184,12 +185,16 @@ int main(int argc, char *argv[])
 
   // build and compile shaders
   // -------------------------
-  Shader ourShader(FileSystem::getPath("src/final/final/model.vs").c_str(), FileSystem::getPath("src/final/final/model.fs").c_str());
+  std::string shadowDefines = "#define SHADOW_KERNEL " + std::to_string(SHADOW_KERNEL) + "\n";
+  if (SHADOW_MODE == SHADOW_EVSM)
+    shadowDefines += "#define SHADOW_EVSM 1\n";
+  Shader ourShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/model.vs").c_str(), FileSystem::getPath("src/final/final/model.fs").c_str(), nullptr, "model", shadowDefines);
 
   // load models
   // -----------
   //Model ourModel(FileSystem::getPath("resources/textures/landscape/mill.obj"));
-  Model ourModel(FileSystem::getPath("resources/textures/landscape/mill_without_water.obj"));
+  // parsed by Assimp once, later runs map the binary cache written next to the obj
+  StaticModel ourModel = ModelCache::Load(FileSystem::getPath("resources/textures/landscape/mill_without_water.obj"));
 
   // load wood
   // ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/wood.jpg").c_str(), false, "wood");
@@ -216,24 +221,82 @@ int main(int argc, char *argv[])
 		  FileSystem::getPath("resources/textures/night/night_bk.png") };
 
   Skybox skybox(glm::vec3(1), glm::vec3(1), glm::vec3(1), faces, faces2, "skybox_s", "skybox_n");
+  auto skyboxShader = ResourceManager::GetShader("skybox");
+  skyboxShader.use();
+  skyboxShader.setInt("skybox1", 0);
+  skyboxShader.setInt("skybox2", 1);
+
+  bool tessellate = TESSELLATION && TessellatedTerrain::Supported();
 
-  /*
   // load plane
-  auto planeShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/plane.vs").c_str(), FileSystem::getPath("src/final/final/plane.fs").c_str(), nullptr, "plane");
-  planeShader.use();
-  planeShader.setInt("texture1", 0);
-  planeShader.setInt("texture2", 1);
-  planeShader.setInt("mask", 2);
-  planeShader.setInt("shadowMap", 3);
-  ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/grass_2.jpg").c_str(), true, "grass");
-  ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/mountain.png").c_str(), true, "mountain");
-  ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/mask.png").c_str(), false, "mask");
-  Plane plane(glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), glm::vec3(1), FileSystem::getPath("resources/textures/plane/height_2.jpg").c_str());
-  */
+  // height and ray queries against the drawn terrain, and the node and patch heights of the CDLOD and
+  // tessellated ones. A streamed terrain keeps the whole heightmap out of memory, so it has none.
+  HeightPyramid *terrainHeights = NULL;
+  SplatTexture *splat = NULL;
+  Plane *plane = NULL;
+  Terrain *terrain = NULL;
+  TerrainTileCache *terrainTiles = NULL;
+  TessellatedTerrain *tessTerrain = NULL;
+  if (TERRAIN)
+  {
+    // the CDLOD and tessellated terrains share the fragment shader and samplers, they bind their height texture
+    std::string terrainDefines = shadowDefines;
+    if (TERRAIN_CDLOD && TERRAIN_STREAMED)
+      terrainDefines += "#define TERRAIN_STREAMED 1\n";
+    if (TERRAIN_SPLAT)
+      terrainDefines += "#define TERRAIN_SPLAT 1\n";
+    auto planeShader = tessellate
+      ? ResourceManager::LoadTessellationShader(FileSystem::getPath("src/final/final/terrain_tess.vs").c_str(), FileSystem::getPath("src/final/final/terrain_tess.tcs").c_str(),
+                                                FileSystem::getPath("src/final/final/terrain_tess.tes").c_str(), FileSystem::getPath("src/final/final/plane.fs").c_str(), "plane", terrainDefines)
+      : ResourceManager::LoadShader(FileSystem::getPath(TERRAIN_CDLOD ? "src/final/final/terrain.vs" : "src/final/final/plane.vs").c_str(), FileSystem::getPath("src/final/final/plane.fs").c_str(), nullptr, "plane", terrainDefines);
+    planeShader.use();
+    planeShader.setInt("texture1", 0);
+    planeShader.setInt("texture2", 1);
+    planeShader.setInt("mask", 2);
+    planeShader.setInt("shadowMap", 3);
+    // the layers are blended once into the pages of the splat, or per pixel
+    if (TERRAIN_SPLAT)
+      splat = new SplatTexture(FileSystem::getPath("resources/textures/plane/mountain.png").c_str(), FileSystem::getPath("resources/textures/plane/grass_2.jpg").c_str(),
+                               FileSystem::getPath("resources/textures/plane/mask.png").c_str(), FileSystem::getPath("resources/textures/plane/height_2.jpg").c_str(),
+                               glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), TERRAIN_SPLAT_SIZE, TERRAIN_SPLAT_ATLAS);
+    if (splat)
+    {
+      planeShader.use();
+      splat->SetUniforms(&planeShader, 0, 1);
+    }
+    else
+    {
+      ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/grass_2.jpg").c_str(), true, "grass");
+      ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/mountain.png").c_str(), true, "mountain");
+      ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/plane/mask.png").c_str(), false, "mask");
+    }
+    bool streamed = !tessellate && TERRAIN_CDLOD && TERRAIN_STREAMED;
+    if (!streamed)
+      terrainHeights = new HeightPyramid(FileSystem::getPath("resources/textures/plane/height_2.jpg").c_str(), glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1));
+    if (tessellate)
+      tessTerrain = new TessellatedTerrain(glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), glm::vec3(1), *terrainHeights, TESS_TRIANGLE_SIZE);
+    else if (streamed)
+    {
+      std::string tileFile = FileSystem::getPath("resources/textures/plane/height_2.tiles");
+      TerrainTileCache::Refresh(FileSystem::getPath("resources/textures/plane/height_2.jpg").c_str(), tileFile.c_str());
+      terrainTiles = new TerrainTileCache(tileFile.c_str(), TERRAIN_TILE_SLOTS);
+      terrain = new Terrain(glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), glm::vec3(1), terrainTiles, TERRAIN_LOD_DISTANCE);
+    }
+    else if (TERRAIN_CDLOD)
+      terrain = new Terrain(glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), glm::vec3(1), *terrainHeights, TERRAIN_LOD_DISTANCE);
+    else
+      plane = new Plane(glm::vec3(-125, 0, -125), glm::vec3(1, 0.3, 1), glm::vec3(1), FileSystem::getPath("resources/textures/plane/height_2.jpg").c_str());
+  }
   
   // load grass
   
-  auto grassShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/grass.vs").c_str(), FileSystem::getPath("src/final/final/grass.fs").c_str(), FileSystem::getPath("src/final/final/grass.gs").c_str(), "grass");
+  Grass::Instanced = GRASS_INSTANCED;
+  Grass::Lod = GRASS_LOD;
+  bool gpuGrass = GRASS_INSTANCED && GRASS_GPU_CULLING && GrassField::Supported();
+  std::string grassDefines = shadowDefines + (GRASS_WIND_FIELD ? "#define GRASS_WIND_FIELD 1\n" : "");
+  auto grassShader = GRASS_INSTANCED
+    ? ResourceManager::LoadShader(FileSystem::getPath("src/final/final/grass_instanced.vs").c_str(), FileSystem::getPath("src/final/final/grass.fs").c_str(), nullptr, "grass", grassDefines + (gpuGrass ? "#define GRASS_GPU_CULLED 1\n" : "#define GRASS_BATCHED 1\n"))
+    : ResourceManager::LoadShader(FileSystem::getPath("src/final/final/grass.vs").c_str(), FileSystem::getPath("src/final/final/grass.fs").c_str(), FileSystem::getPath("src/final/final/grass.gs").c_str(), "grass", grassDefines);
   glm::vec3 grassPos(-40.0f, -6.0f, 30.0f);
   glm::vec3 grassScale(2, 0.6, 2);
   Grass grass(grassPos, grassScale, glm::vec3(1), 25, 5, 0.5);
@@ -245,36 +308,37 @@ int main(int argc, char *argv[])
   Grass grass4(grassPos4, grassScale, glm::vec3(1), 7, 7, 0.6);
   glm::vec3 grassPos5(-38.0f, -6.0f, 45.0f);
   Grass grass5(grassPos5, grassScale, glm::vec3(1), 7, 7, 0.6);
-  ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/grass.png").c_str(), true, "t_grass");
-  ResourceManager::LoadTexture(FileSystem::getPath("resources/textures/alpha.png").c_str(), true, "a_grass");
+  std::vector<Grass *> patches = {&grass, &grass2, &grass3, &grass4, &grass5};
+  // painted grass: one patch per chunk of the terrain, owned here
+  std::vector<Grass *> scatteredPatches;
+  if (GRASS_SCATTER)
+  {
+    GrassScatterDesc scatter;
+    scatter.DensityMap = FileSystem::getPath("resources/textures/plane/mask.png");
+    scatter.HeightMap = FileSystem::getPath("resources/textures/plane/height_2.jpg");
+    scatter.TerrainPosition = glm::vec3(-125, 0, -125);
+    scatter.TerrainScale = glm::vec3(1, 0.3, 1);
+    scatter.Spacing = GRASS_SCATTER_SPACING;
+    scatter.ChunkSize = GRASS_SCATTER_CHUNK;
+    scatter.Seed = 1;
+    std::vector<GrassScatterChunk> chunks = GrassScatter::Generate(scatter);
+    for (size_t i = 0; i < chunks.size(); i++)
+      scatteredPatches.push_back(GrassScatter::CreatePatch(chunks[i], scatter, grassScale));
+    patches.insert(patches.end(), scatteredPatches.begin(), scatteredPatches.end());
+  }
+  // blade colour with the cutout mask in alpha, so grass binds a single texture
+  ResourceManager::LoadMaskedTexture(FileSystem::getPath("resources/textures/grass.png").c_str(), FileSystem::getPath("resources/textures/alpha.png").c_str(), "t_grass");
   grassShader.use();
   grassShader.setInt("texture1", 0);
-  grassShader.setInt("alpha", 1);
   grassShader.setInt("shadowMap", 2);
 
-  auto shadowShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/shadow_mapping.vs").c_str(), FileSystem::getPath("src/final/final/shadow_mapping.fs").c_str(), nullptr, "shadow_mapping");
-  auto depthShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/shadow_mapping_depth.vs").c_str(), FileSystem::getPath("src/final/final/shadow_mapping_depth.fs").c_str(), nullptr, "shadow_mapping_depth");
-
-  const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
-  unsigned int depthMapFBO;
-  glGenFramebuffers(1, &depthMapFBO);
-  // create depth texture
-  unsigned int depthMap;
-  glGenTextures(1, &depthMap);
-  glBindTexture(GL_TEXTURE_2D, depthMap);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-  float borderColor[] = {1.0, 1.0, 1.0, 1.0};
-  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-  // attach depth texture as FBO's depth buffer
-  glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  auto shadowShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/shadow_mapping.vs").c_str(), FileSystem::getPath("src/final/final/shadow_mapping.fs").c_str(), nullptr, "shadow_mapping", shadowDefines);
+  auto depthShader = ResourceManager::LoadShader(FileSystem::getPath("src/final/final/shadow_mapping_depth.vs").c_str(), FileSystem::getPath("src/final/final/shadow_mapping_depth.fs").c_str(), nullptr, "shadow_mapping_depth", shadowDefines);
+
+  // depth (or moment) layers of the shadow cascades
+  ShadowCascades cascades(SHADOW_CASCADES, SHADOW_RESOLUTION, SHADOW_MODE);
+  if (SHADOW_MODE == SHADOW_EVSM)
+    cascades.SetBlurShader(ResourceManager::LoadShader(FileSystem::getPath("src/final/final/shadow_blur.vs").c_str(), FileSystem::getPath("src/final/final/shadow_blur.fs").c_str(), nullptr, "shadow_blur"));
 
   glm::vec3 lightPos(5, 100.0f, 100.0f);
   
@@ -284,6 +348,71 @@ int main(int argc, char *argv[])
 	  FileSystem::getPath("src/final/final/gerstner.fs"), 
 	  FileSystem::getPath("resources/wave/water-texture-2.tga"), 
 	  FileSystem::getPath("resources/wave/water-texture-2-normal.tga"));
+  glm::mat4 modelMat = glm::mat4(1.0f);
+  modelMat = glm::translate(modelMat, glm::vec3(-25, -10, 25));
+  modelMat = glm::scale(modelMat, glm::vec3(120, 1, 120));
+  modelMat = glm::rotate(modelMat, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  glm::mat3 NormalMat = glm::transpose(glm::inverse(glm::mat3(modelMat)));
+  glUseProgram(fluid.dataset.program);
+  glUniformMatrix4fv(fluid.dataset.uniforms.model_mat, 1, GL_FALSE, glm::value_ptr(modelMat));
+  glUniformMatrix3fv(fluid.dataset.uniforms.normal_mat, 1, GL_FALSE, glm::value_ptr(NormalMat));
+  // the waves evaluated per tessellated vertex on the GPU instead of per strip vertex on the CPU
+  bool tessWater = tessellate && fluid.initTessellation(ResourceManager::LoadTessellationShader(FileSystem::getPath("src/final/final/gerstner_tess.vs").c_str(), FileSystem::getPath("src/final/final/gerstner_tess.tcs").c_str(),
+                                                                                                FileSystem::getPath("src/final/final/gerstner_tess.tes").c_str(), FileSystem::getPath("src/final/final/gerstner.fs").c_str(), "water_tess").ID, TESS_TRIANGLE_SIZE);
+  if (tessWater)
+  {
+    glUniformMatrix4fv(glGetUniformLocation(fluid.tess_program, "modelMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
+    glUniformMatrix3fv(glGetUniformLocation(fluid.tess_program, "normalMat"), 1, GL_FALSE, glm::value_ptr(NormalMat));
+  }
+
+  // per-draw uniforms, looked up once
+  ourShader.use();
+  ourShader.setInt("shadowMap", 15);
+  GLint ourModelLocation = glGetUniformLocation(ourShader.ID, "model");
+  GLint depthModelLocation = glGetUniformLocation(depthShader.ID, "model");
+  GLint depthCascadeLocation = glGetUniformLocation(depthShader.ID, "cascade");
+
+  glm::mat4 modelModel = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, -1.0f, 12.0f));
+  modelModel = glm::scale(modelModel, glm::vec3(50, 50, 50));
+
+  // static scene hierarchy, culled against the camera and the light every frame
+  const unsigned int PATCH_COUNT = patches.size();
+  BVH scene;
+  for (unsigned int i = 0; i < ourModel.Meshes.size(); i++)
+    scene.Add(SCENE_MODEL_MESH, i, ourModel.Meshes[i].Bounds.Transformed(modelModel));
+  for (unsigned int i = 0; i < PATCH_COUNT; i++)
+    scene.Add(SCENE_GRASS, i, patches[i]->Bounds());
+  for (int c = 0; c < STRIP_COUNT - 1; c++)
+    scene.Add(SCENE_WATER, c, fluid.stripBounds(c).Transformed(modelMat));
+  scene.Build();
+  // all patches merged into one buffer and drawn at once, culled on the GPU
+  // where possible. The geometry shader path draws the patches one by one.
+  GrassField *grassField = NULL;
+  if (gpuGrass)
+    grassField = new GrassField(&patches[0], PATCH_COUNT, ResourceManager::LoadComputeShader(FileSystem::getPath("src/final/final/grass_cull.cs").c_str(), "grass_cull"));
+  else if (GRASS_INSTANCED)
+    grassField = new GrassField(&patches[0], PATCH_COUNT);
+  // one square of wind over all the grass
+  WindField *windField = NULL;
+  if (GRASS_WIND_FIELD)
+  {
+    AABB grassArea;
+    for (unsigned int i = 0; i < PATCH_COUNT; i++)
+      grassArea.Extend(patches[i]->Bounds());
+    float extent = std::max(grassArea.Max.x - grassArea.Min.x, grassArea.Max.z - grassArea.Min.z);
+    windField = new WindField(glm::vec2(grassArea.Min.x, grassArea.Min.z), extent, GRASS_WIND_MEAN);
+    Grass::Wind = windField;
+    // the unit and the area never change
+    grassShader.use();
+    windField->SetUniforms(grassShader.ID, Grass::WIND_TEXTURE_UNIT);
+  }
+  std::vector<std::vector<unsigned char> > cameraVisible(SCENE_KIND_COUNT), lightVisible(SCENE_KIND_COUNT);
+  unsigned int kindSizes[SCENE_KIND_COUNT] = {(unsigned int)ourModel.Meshes.size(), PATCH_COUNT, STRIP_COUNT - 1};
+  for (int k = 0; k < SCENE_KIND_COUNT; k++)
+  {
+    cameraVisible[k].resize(kindSizes[k]);
+    lightVisible[k].resize(kindSizes[k]);
+  }
 
 
   while (!glfwWindowShouldClose(window))
@@ -292,6 +421,13 @@ int main(int argc, char *argv[])
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
     processInput(window);
+    ResourceManager::NextFrame();
+    // the tessellated surfaces size their triangles in pixels of the current framebuffer
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    // walk over the terrain instead of through it
+    if (CAMERA_GROUND_CLEARANCE > 0.0f && terrainHeights)
+      camera.Position.y = std::max(camera.Position.y, terrainHeights->HeightAt(camera.Position.x, camera.Position.z) + CAMERA_GROUND_CLEARANCE);
 
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -300,33 +436,60 @@ int main(int argc, char *argv[])
 	lightPos = glm::vec3(5, 0, 0) + glm::vec3(0, 100 * cos(glfwGetTime() / 10), 100 * sin(glfwGetTime() / 10));
     // 1. render depth of scene to texture (from light's perspective)
     // --------------------------------------------------------------
-    glm::mat4 lightProjection, lightView;
-    glm::mat4 lightSpaceMatrix;
-    float near_plane = 1.0f, far_plane = 250.5f;
-    lightProjection = glm::ortho(-150.0f, 150.0f, -150.0f, 150.0f, near_plane, far_plane);
-    lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-    lightSpaceMatrix = lightProjection * lightView;
-    // render scene from light's point of view
-    glm::mat4 model(1.0f);
-	glm::mat4 modelModel = glm::translate(model ,glm::vec3(3.0f, -1.0f, 12.0f));
-	modelModel = glm::scale(modelModel, glm::vec3(50, 50, 50));
+	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+	glm::mat4 view = camera.GetViewMatrix();
+	// below the horizon the lighting shaders treat everything as shadowed,
+	// the shadow pass is skipped and the cached layers are left alone
+	bool sunUp = lightPos.y >= 0;
+	// fit the cascades to the camera, the whole scene may cast shadows into them
+	if (sunUp)
+		cascades.Update(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, CAMERA_NEAR, SHADOW_DISTANCE, lightPos, scene.Bounds());
+
+	// upload the camera and light data shared by all scene shaders
+	FrameData frame;
+	frame.projection = projection;
+	frame.view = view;
+	// the outermost cascade, for shaders still sampling a single shadow map
+	frame.lightSpaceMatrix = cascades.Data.cascadeMatrices[SHADOW_CASCADES - 1];
+	frame.viewPos = camera.Position;
+	frame.time = glfwGetTime() / 10;
+	frame.lightPos = lightPos;
+	frame.dayCycle = time;
+	FrameUniforms::Update(frame);
+	// the wind terms every grass blade shares, once per frame instead of per vertex
+	Grass::UpdateWind(frame.time);
+	grassShader.use();
+	Grass::SetWind(grassShader.ID);
+	if (windField)
+		windField->Update(deltaTime);
+
+	scene.Cull(Frustum(projection * view), cameraVisible);
+	CullingStats cameraStats = scene.Stats;
+
+    // render scene from light's point of view, only into the cascades whose cached layer is stale
     depthShader.use();
-    depthShader.setMat4("model", model);
-    depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    //wood.Draw(&depthShader);
-    //plane.Draw(&depthShader);
-	depthShader.setMat4("model", modelModel);
-	ourModel.Draw(depthShader);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUniformMatrix4fv(depthModelLocation, 1, GL_FALSE, glm::value_ptr(modelModel));
+	CullingStats lightStats;
+	int shadowRedraws = 0;
+	for (int i = 0; i < SHADOW_CASCADES && sunUp; i++)
+	{
+		if (!cascades.Dirty[i])
+			continue;
+		shadowRedraws++;
+		scene.Cull(Frustum(cascades.Data.cascadeMatrices[i]), lightVisible);
+		lightStats.NodesTested += scene.Stats.NodesTested;
+		lightStats.Visible += scene.Stats.Visible;
+		lightStats.Culled += scene.Stats.Culled;
+
+		cascades.Begin(i);
+		glUniform1i(depthCascadeLocation, i);
+		//wood.Draw(&depthShader);
+		//plane.Draw(&depthShader);
+		ourModel.DrawDepth(lightVisible[SCENE_MODEL_MESH]);
+	}
 
-    // reset viewport
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    // reset framebuffer and viewport
+    cascades.End(SCR_WIDTH, SCR_HEIGHT);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // 2. render scene as normal using the generated depth/shadow map
@@ -335,74 +498,70 @@ int main(int argc, char *argv[])
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     shadowShader.use();
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    shadowShader.setMat4("projection", projection);
-    shadowShader.setMat4("view", view);
-    // set light uniforms
-    shadowShader.setVec3("viewPos", camera.Position);
-    shadowShader.setVec3("lightPos", lightPos);
-    shadowShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    cascades.Bind(GL_TEXTURE1);
     wood.Draw(&shadowShader);*/
 
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	/*
-
-
-	// draw plane
-	
-    auto planeShader = ResourceManager::GetShader("plane");
-    planeShader.use();
-    glActiveTexture(GL_TEXTURE0); // 在绑定纹理之前先激活纹理单元
-    glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("mountain").ID);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("grass").ID);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("mask").ID);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    planeShader.setMat4("projection", projection);
-    planeShader.setMat4("view", view);
-    planeShader.setVec3("viewPos", camera.Position);
-    planeShader.setVec3("lightPos", lightPos);
-    planeShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    plane.Draw(&planeShader);
-	*/
+    // draw plane
+    if (TERRAIN)
+    {
+      auto planeShader = ResourceManager::GetShader("plane");
+      planeShader.use();
+      if (splat)
+      {
+        // bake the pages this view needs, then one lookup per pixel
+        splat->Update(projection, view, camera.Position, (float)SCR_HEIGHT);
+        splat->Bind(0, 1);
+      }
+      else
+      {
+        glActiveTexture(GL_TEXTURE0); // 在绑定纹理之前先激活纹理单元
+        glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("mountain").ID);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("grass").ID);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, ResourceManager::GetTexture("mask").ID);
+      }
+      cascades.Bind(GL_TEXTURE3);
+      if (tessTerrain)
+        tessTerrain->Draw(&planeShader, glm::vec2(framebufferWidth, framebufferHeight));
+      else if (terrain)
+      {
+        terrain->Select(Frustum(projection * view), camera.Position);
+        terrain->Draw(&planeShader);
+        // upload the tiles loaded meanwhile and queue the ones this frame missed
+        if (terrainTiles)
+          terrainTiles->Update();
+      }
+      else
+        plane->Draw(&planeShader);
+    }
 	
     // draw grass
 	
+    if (grassField)
+      grassField->Cull(Frustum(projection * view), camera.Position);
     grassShader.use();
-    grassShader.setMat4("projection", projection);
-    grassShader.setMat4("view", view);
-    grassShader.setVec3("viewPos", camera.Position);
-    grassShader.setVec3("lightPos", lightPos);
-    grassShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    grassShader.setFloat("Time", glfwGetTime() / 10);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    grass.Draw(&grassShader);
-    grass2.Draw(&grassShader);
-    grass3.Draw(&grassShader);
-    grass4.Draw(&grassShader);
-    grass5.Draw(&grassShader);
+    cascades.Bind(GL_TEXTURE2);
+    glDisable(GL_BLEND);
+    glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    if (grassField)
+      grassField->Draw(&grassShader);
+    else
+    {
+      for (unsigned int i = 0; i < PATCH_COUNT; i++)
+        if (cameraVisible[SCENE_GRASS][i])
+          patches[i]->Draw(&grassShader, camera.Position);
+    }
+    glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    glEnable(GL_BLEND);
 	
     // draw frog
     ourShader.use();
-    ourShader.setInt("shadowMap", 15);
-    ourShader.setMat4("projection", projection);
-    ourShader.setMat4("view", view);
-    ourShader.setVec3("viewPos", camera.Position);
-    ourShader.setVec3("lightPos", lightPos);
-    ourShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    glActiveTexture(GL_TEXTURE15);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    cascades.Bind(GL_TEXTURE15);
 
     // render the loaded model
-    ourShader.setMat4("model", modelModel);
-	ourModel.Draw(ourShader);
+    glUniformMatrix4fv(ourModelLocation, 1, GL_FALSE, glm::value_ptr(modelModel));
+	ourModel.Draw(ourShader, cameraVisible[SCENE_MODEL_MESH]);
 	
 	
 	
@@ -411,38 +570,19 @@ int main(int argc, char *argv[])
 	
 
 	// render skybox
-    auto skyboxShader = ResourceManager::GetShader("skybox");
-    skyboxShader.use();
-    view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-    skyboxShader.setMat4("view", view);
-    skyboxShader.setMat4("projection", projection);
-	skyboxShader.setFloat("time", time);
     skybox.Draw(&skyboxShader);
 
 	// render lake
 
-	glm::mat4 Projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
-	glm::mat4 ModelViewMat = camera.GetViewMatrix();
-	glm::mat4 modelMat = glm::mat4(1.0f);
-	modelMat = glm::translate(modelMat, glm::vec3(-25, -10, 25));
-	modelMat = glm::scale(modelMat, glm::vec3(120, 1, 120));
-	modelMat = glm::rotate(modelMat, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-	glm::mat3 NormalMat = glm::transpose(glm::inverse(glm::mat3(ModelViewMat)));
+	if (tessWater)
+		fluid.drawTessellated((float)framebufferWidth, (float)framebufferHeight);
+	else {
 	glUseProgram(fluid.dataset.program);
-	glUniformMatrix4fv(glGetUniformLocation(fluid.dataset.program, "modelViewMat"), 1, GL_FALSE, glm::value_ptr(ModelViewMat));
-	glUniformMatrix4fv(glGetUniformLocation(fluid.dataset.program, "perspProjMat"), 1, GL_FALSE, glm::value_ptr(Projection));
-	glUniformMatrix3fv(glGetUniformLocation(fluid.dataset.program, "normalMat"), 1, GL_FALSE, glm::value_ptr(NormalMat));
-	glUniformMatrix4fv(glGetUniformLocation(fluid.dataset.program, "modelMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-	//glUniform4fv(glGetUniformLocation(fluid.dataset.program, "modelViewMat"), 1, glm::value_ptr(ModelViewMat));
-	//glUniform4fv(glGetUniformLocation(fluid.dataset.program, "perspProjMat"), 1, glm::value_ptr(Projection));
-	//glUniform3fv(glGetUniformLocation(fluid.dataset.program, "normalMat"), 1, glm::value_ptr(NormalMat));
-	//glUniform3fv(glGetUniformLocation(fluid.dataset.program, "modelMat"), 1, glm::value_ptr(modelMat));
 
 	fluid.calculateWave();
 	glBindVertexArray(fluid.VAO);
 
-	glUniform1f(glGetUniformLocation(fluid.dataset.program, "time"), fluid.water.time);
-	glUniform3fv(glGetUniformLocation(fluid.dataset.program, "lightPos"), 1, glm::value_ptr(lightPos));
+	glUniform1f(fluid.dataset.uniforms.time, fluid.water.time);
 
 	glBindBuffer(GL_ARRAY_BUFFER, fluid.dataset.vertex_buffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(fluid.vertex_data), fluid.vertex_data, GL_STATIC_DRAW);
@@ -461,13 +601,25 @@ int main(int argc, char *argv[])
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, fluid.dataset.normal_texture);
 	for (int c = 0; c < (STRIP_COUNT - 1); c++) {
+		if (!cameraVisible[SCENE_WATER][c])
+			continue;
 		glDrawArrays(GL_TRIANGLE_STRIP, STRIP_LENGTH * 2 * c, STRIP_LENGTH * 2);
 	}
+	}
 
 	//文字显示----
 	string texttime = to_string(int(currentFrame / 10 / 3.1416 / 2 * 24 + 12) % 24);
 	string mytext = "time: " + texttime + ":00";
-	RenderText(textshader, mytext, 570.0f, 570.0f, 0.5f, glm::vec3(1.0f, 0.7f, 0.3f));
+	QueueText(mytext, 570.0f, 570.0f, 0.5f, glm::vec3(1.0f, 0.7f, 0.3f));
+	if (showStats)
+	{
+		string camText = "camera: " + to_string(cameraStats.Visible) + " drawn " + to_string(cameraStats.Culled) + " culled " + to_string(cameraStats.NodesTested) + " nodes";
+		string lightText = "light: " + to_string(lightStats.Visible) + " drawn " + to_string(lightStats.Culled) + " culled " + to_string(lightStats.NodesTested) + " nodes";
+		QueueText(camText, 10.0f, 40.0f, 0.35f, glm::vec3(1.0f));
+		QueueText(lightText, 10.0f, 15.0f, 0.35f, glm::vec3(1.0f));
+		QueueText("shadow: " + to_string(shadowRedraws) + "/" + to_string(SHADOW_CASCADES) + " cascades redrawn", 10.0f, 65.0f, 0.35f, glm::vec3(1.0f));
+	}
+	RenderText(textshader);
 
 	//文字显示----
 
@@ -479,6 +631,45 @@ int main(int argc, char *argv[])
 
   // Delete all resources as loaded using the resource manager
   ResourceManager::Clear();
+  FrameUniforms::Clear();
+  cascades.Release();
+  Grass::Wind = NULL;
+  delete windField;
+  if (terrain)
+  {
+    terrain->Release();
+    delete terrain;
+  }
+  if (tessTerrain)
+  {
+    tessTerrain->Release();
+    delete tessTerrain;
+  }
+  if (plane)
+  {
+    plane->Release();
+    delete plane;
+  }
+  delete terrainTiles;
+  delete splat;
+  delete terrainHeights;
+  if (grassField)
+  {
+    grassField->Release();
+    delete grassField;
+  }
+  for (size_t i = 0; i < scatteredPatches.size(); i++)
+  {
+    scatteredPatches[i]->Release();
+    delete scatteredPatches[i];
+  }
+  ourModel.Release();
+  if (textBatch)
+  {
+    textBatch->Release();
+    delete textBatch;
+  }
+  glyphAtlas.Release();
   glfwTerminate();
   return 0;
 }
@@ -492,6 +683,8 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
   {
     if (action == GLFW_PRESS)
     {
+      if (key == GLFW_KEY_F1)
+        showStats = !showStats;
     }
 
     else if (action == GLFW_RELEASE)
@@ -554,46 +747,14 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 }
 
 // 显示文字----
-void RenderText(Shader &shader, std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color) {
-	// Activate corresponding render state	
-	shader.use();
-	glUniform3f(glGetUniformLocation(shader.ID, "textColor"), color.x, color.y, color.z);
-	glActiveTexture(GL_TEXTURE0);
-	glBindVertexArray(textVAO);
-
-	// Iterate through all characters
-	std::string::const_iterator c;
-	for (c = text.begin(); c != text.end(); c++) {
-		Character ch = Characters[*c];
-
-		GLfloat xpos = x + ch.Bearing.x * scale;
-		GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-		GLfloat w = ch.Size.x * scale;
-		GLfloat h = ch.Size.y * scale;
-		// Update VBO for each character
-		GLfloat vertices[6][4] = {
-			{ xpos,     ypos + h,   0.0, 0.0 },
-		{ xpos,     ypos,       0.0, 1.0 },
-		{ xpos + w, ypos,       1.0, 1.0 },
-
-		{ xpos,     ypos + h,   0.0, 0.0 },
-		{ xpos + w, ypos,       1.0, 1.0 },
-		{ xpos + w, ypos + h,   1.0, 0.0 }
-		};
-		// Render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-		// Update content of VBO memory
-		glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
-
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		// Render quad
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		// Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-		x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
-	}
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+void QueueText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color) {
+	if (textBatch)
+		textBatch->Add(text, x, y, scale, color);
+}
+
+void RenderText(Shader &shader) {
+	// One texture, one buffer update and one draw for all strings queued this frame
+	if (textBatch)
+		textBatch->Draw(shader);
 }
 // 显示文字----
\ No newline at end of file
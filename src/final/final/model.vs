@@ -9,7 +9,6 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 
 	vec3 TangentNormal;
 	vec3 TangentLightPos;
@@ -17,16 +16,12 @@ out VS_OUT {
 	vec3 TangentFragPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "frame_data.glsl"
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
 
 uniform bool hasNormalTexture;
 uniform sampler2D texture_normal1;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
 
 void main()
 {
@@ -55,6 +50,5 @@ void main()
 		vs_out.TangentFragPos = vs_out.FragPos;
 	}
     
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
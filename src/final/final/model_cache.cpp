@@ -0,0 +1,596 @@
+#include "model_cache.h"
+#include "resource_manager.h"
+#include "util.h"
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <cstring>
+
+#include <learnopengl/model.h>
+#include <stb_image.h>
+
+namespace
+{
+  const unsigned int CACHE_VERSION = 3;
+
+  // File layout, every section starts 4 byte aligned:
+  //   CacheHeader
+  //   CacheMesh[MeshCount]
+  //   CacheMaterial[MaterialCount]
+  //   CacheTexture[TextureCount]
+  //   CacheDependency[DependencyCount]
+  //   Vertex[VertexCount]
+  //   index data (IndexBytes), each mesh padded to 4 bytes
+  //   string table (StringBytes), zero terminated strings
+  struct CacheHeader
+  {
+    char Magic[4]; // "MSHC"
+    unsigned int Version;
+    long long SourceTime;
+    long long SourceSize;
+    unsigned long long SourceHash;
+    unsigned int MeshCount, MaterialCount, TextureCount, DependencyCount, VertexCount;
+    unsigned int IndexBytes, StringBytes;
+  };
+  struct CacheMesh
+  {
+    unsigned int BaseVertex, VertexCount;
+    unsigned int IndexOffset, IndexCount, IndexSize; // IndexSize is 2 or 4
+    unsigned int Material;
+    float BoundsMin[3], BoundsMax[3]; // model space
+  };
+  struct CacheMaterial
+  {
+    unsigned int FirstTexture, TextureCount;
+  };
+  struct CacheTexture
+  {
+    unsigned int Type, Path; // offsets into the string table
+  };
+  // A file the cache was built from besides the source, a material library
+  // or a texture, stamped so that editing it rebuilds the cache
+  struct CacheDependency
+  {
+    unsigned int Path;    // offset into the string table, relative to the model's directory
+    unsigned int Missing; // the file did not exist at build time
+    long long Time, Size;
+  };
+
+  static_assert(sizeof(Vertex) == 14 * sizeof(float), "Vertex must be tightly packed to be uploaded from the cache");
+
+  bool sourceInfo(const std::string &path, long long &time, long long &size)
+  {
+    return file_info(path.c_str(), &time, &size);
+  }
+
+  bool sourceHash(const std::string &path, unsigned long long &hash)
+  {
+    return hash_file(path.c_str(), &hash);
+  }
+
+  // Names of the material libraries an .obj file references
+  void materialLibraries(const std::string &path, std::vector<std::string> &names)
+  {
+    std::ifstream file(path.c_str());
+    std::string line;
+    while (std::getline(file, line))
+    {
+      if (line.compare(0, 7, "mtllib ") != 0)
+        continue;
+      std::string name = line.substr(7);
+      size_t end = name.find_last_not_of(" \t\r");
+      if (end != std::string::npos)
+        names.push_back(name.substr(0, end + 1));
+    }
+  }
+
+  // True when a dependency still has the time and size it had at build time
+  bool current(const CacheDependency &dependency, const std::string &path)
+  {
+    long long time, size;
+    if (!sourceInfo(path, time, size))
+      return dependency.Missing != 0;
+    return !dependency.Missing && time == dependency.Time && size == dependency.Size;
+  }
+
+  // True when every offset and count upload() follows stays inside the image,
+  // the section sizes themselves were checked against the file size already
+  bool consistent(const char *data, const CacheHeader &header)
+  {
+    const CacheMesh *meshes = (const CacheMesh *)(data + sizeof(CacheHeader));
+    const CacheMaterial *materials = (const CacheMaterial *)(meshes + header.MeshCount);
+    const CacheTexture *textures = (const CacheTexture *)(materials + header.MaterialCount);
+    const CacheDependency *dependencies = (const CacheDependency *)(textures + header.TextureCount);
+    const char *strings = (const char *)(dependencies + header.DependencyCount) + (size_t)header.VertexCount * sizeof(Vertex) + header.IndexBytes;
+    // every string read from the table stops at its end
+    if (header.StringBytes > 0 && strings[header.StringBytes - 1] != '\0')
+      return false;
+    for (unsigned int i = 0; i < header.MeshCount; i++)
+    {
+      const CacheMesh &mesh = meshes[i];
+      if ((mesh.IndexSize != 2 && mesh.IndexSize != 4) || mesh.Material >= header.MaterialCount)
+        return false;
+      if ((unsigned long long)mesh.BaseVertex + mesh.VertexCount > header.VertexCount)
+        return false;
+      if (mesh.IndexOffset % mesh.IndexSize != 0 || (unsigned long long)mesh.IndexOffset + (unsigned long long)mesh.IndexCount * mesh.IndexSize > header.IndexBytes)
+        return false;
+    }
+    for (unsigned int i = 0; i < header.MaterialCount; i++)
+      if ((unsigned long long)materials[i].FirstTexture + materials[i].TextureCount > header.TextureCount)
+        return false;
+    for (unsigned int i = 0; i < header.TextureCount; i++)
+      if (textures[i].Type >= header.StringBytes || textures[i].Path >= header.StringBytes)
+        return false;
+    for (unsigned int i = 0; i < header.DependencyCount; i++)
+      if (dependencies[i].Path >= header.StringBytes)
+        return false;
+    return true;
+  }
+
+  size_t align4(size_t size)
+  {
+    return (size + 3) & ~(size_t)3;
+  }
+
+  template <typename T>
+  void append(std::vector<char> &image, const T *data, size_t count)
+  {
+    const char *bytes = (const char *)data;
+    image.insert(image.end(), bytes, bytes + sizeof(T) * count);
+  }
+
+  // Deletes the GL objects an Assimp Model created, the cache owns its own copies
+  void releaseModel(Model &model)
+  {
+    for (unsigned int i = 0; i < model.meshes.size(); i++)
+    {
+      GLint vbo = 0, ebo = 0;
+      glBindVertexArray(model.meshes[i].VAO);
+      glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+      glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vbo);
+      glBindVertexArray(0);
+      GLuint buffers[2] = {(GLuint)vbo, (GLuint)ebo};
+      glDeleteBuffers(2, buffers);
+      glDeleteVertexArrays(1, &model.meshes[i].VAO);
+    }
+    for (unsigned int i = 0; i < model.textures_loaded.size(); i++)
+      glDeleteTextures(1, &model.textures_loaded[i].id);
+  }
+}
+
+StaticModel ModelCache::Load(const std::string &path)
+{
+  std::string cachePath = path + ".meshcache";
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  long long cacheTime, cacheSize;
+  mapped_file cache;
+  // no cache yet is the normal first run, not worth a message from map_file
+  if (sourceInfo(cachePath, cacheTime, cacheSize) && map_file(cachePath.c_str(), &cache))
+  {
+    const char *data = (const char *)cache.data;
+    bool touched = false;
+    if (valid(data, cache.size, path, touched))
+    {
+      StaticModel model = upload(data, directory);
+      CacheHeader header;
+      memcpy(&header, data, sizeof(header));
+      // Unmapped before the header is rewritten, Windows does not open a mapped file for writing
+      unmap_file(&cache);
+      if (touched)
+      {
+        // Same content with a new timestamp, refresh the header so the hash is skipped next time
+        long long time, size;
+        sourceInfo(path, time, size);
+        header.SourceTime = time;
+        std::fstream file(cachePath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        if (!file || !file.write((const char *)&header, sizeof(header)))
+          std::cout << "ERROR::MODEL_CACHE: Failed to update " << cachePath << std::endl;
+      }
+      return model;
+    }
+    unmap_file(&cache);
+  }
+
+  std::vector<char> image;
+  if (!build(path, image))
+    return StaticModel();
+  std::ofstream file(cachePath.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file || !file.write(&image[0], image.size()))
+    std::cout << "ERROR::MODEL_CACHE: Failed to write " << cachePath << std::endl;
+  return upload(&image[0], directory);
+}
+
+bool ModelCache::build(const std::string &path, std::vector<char> &image)
+{
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.Magic, "MSHC", 4);
+  header.Version = CACHE_VERSION;
+  if (!sourceInfo(path, header.SourceTime, header.SourceSize) || !sourceHash(path, header.SourceHash))
+  {
+    std::cout << "ERROR::MODEL_CACHE: Failed to read " << path << std::endl;
+    return false;
+  }
+
+  Model model(path);
+
+  std::vector<CacheMesh> meshes;
+  std::vector<CacheMaterial> materials;
+  std::vector<CacheTexture> textures;
+  std::vector<CacheDependency> dependencies;
+  std::vector<char> indices, strings;
+  std::map<std::string, unsigned int> stringOffsets;
+  std::map<std::string, unsigned int> materialIds;
+  unsigned int vertexCount = 0;
+
+  struct
+  {
+    std::vector<char> *table;
+    std::map<std::string, unsigned int> *offsets;
+    unsigned int operator()(const std::string &str)
+    {
+      std::map<std::string, unsigned int>::iterator iter = offsets->find(str);
+      if (iter != offsets->end())
+        return iter->second;
+      unsigned int offset = (unsigned int)table->size();
+      table->insert(table->end(), str.c_str(), str.c_str() + str.size() + 1);
+      (*offsets)[str] = offset;
+      return offset;
+    }
+  } intern = {&strings, &stringOffsets};
+
+  for (unsigned int i = 0; i < model.meshes.size(); i++)
+  {
+    const Mesh &mesh = model.meshes[i];
+
+    // Meshes with identical texture lists share one material
+    std::string key;
+    for (unsigned int t = 0; t < mesh.textures.size(); t++)
+      key += mesh.textures[t].type + "=" + mesh.textures[t].path + ";";
+    std::map<std::string, unsigned int>::iterator found = materialIds.find(key);
+    unsigned int material;
+    if (found != materialIds.end())
+      material = found->second;
+    else
+    {
+      CacheMaterial entry = {(unsigned int)textures.size(), (unsigned int)mesh.textures.size()};
+      for (unsigned int t = 0; t < mesh.textures.size(); t++)
+      {
+        CacheTexture texture = {intern(mesh.textures[t].type), intern(mesh.textures[t].path)};
+        textures.push_back(texture);
+      }
+      material = (unsigned int)materials.size();
+      materials.push_back(entry);
+      materialIds[key] = material;
+    }
+
+    CacheMesh entry;
+    entry.BaseVertex = vertexCount;
+    entry.VertexCount = (unsigned int)mesh.vertices.size();
+    entry.IndexOffset = (unsigned int)indices.size();
+    entry.IndexCount = (unsigned int)mesh.indices.size();
+    entry.IndexSize = mesh.vertices.size() <= 65536 ? 2 : 4;
+    entry.Material = material;
+    AABB bounds;
+    for (unsigned int k = 0; k < mesh.vertices.size(); k++)
+      bounds.Extend(mesh.vertices[k].Position);
+    for (int axis = 0; axis < 3; axis++)
+    {
+      entry.BoundsMin[axis] = bounds.Min[axis];
+      entry.BoundsMax[axis] = bounds.Max[axis];
+    }
+    if (entry.IndexSize == 2)
+    {
+      for (unsigned int k = 0; k < mesh.indices.size(); k++)
+      {
+        unsigned short index = (unsigned short)mesh.indices[k];
+        append(indices, &index, 1);
+      }
+    }
+    else if (!mesh.indices.empty())
+      append(indices, &mesh.indices[0], mesh.indices.size());
+    indices.resize(align4(indices.size()), 0);
+    meshes.push_back(entry);
+    vertexCount += entry.VertexCount;
+  }
+
+  // Material libraries and textures, each once
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  std::vector<std::string> files;
+  materialLibraries(path, files);
+  for (unsigned int i = 0; i < textures.size(); i++)
+    files.push_back(&strings[textures[i].Path]);
+  std::map<std::string, bool> stamped;
+  for (unsigned int i = 0; i < files.size(); i++)
+  {
+    if (stamped[files[i]])
+      continue;
+    stamped[files[i]] = true;
+    CacheDependency dependency = {intern(files[i]), 0, 0, 0};
+    if (!sourceInfo(directory + "/" + files[i], dependency.Time, dependency.Size))
+      dependency.Missing = 1;
+    dependencies.push_back(dependency);
+  }
+  strings.resize(align4(strings.size()), 0);
+
+  header.MeshCount = (unsigned int)meshes.size();
+  header.MaterialCount = (unsigned int)materials.size();
+  header.TextureCount = (unsigned int)textures.size();
+  header.DependencyCount = (unsigned int)dependencies.size();
+  header.VertexCount = vertexCount;
+  header.IndexBytes = (unsigned int)indices.size();
+  header.StringBytes = (unsigned int)strings.size();
+
+  image.clear();
+  image.reserve(sizeof(header) + meshes.size() * sizeof(CacheMesh) + materials.size() * sizeof(CacheMaterial) + textures.size() * sizeof(CacheTexture) + dependencies.size() * sizeof(CacheDependency) + vertexCount * sizeof(Vertex) + indices.size() + strings.size());
+  append(image, &header, 1);
+  if (!meshes.empty())
+    append(image, &meshes[0], meshes.size());
+  if (!materials.empty())
+    append(image, &materials[0], materials.size());
+  if (!textures.empty())
+    append(image, &textures[0], textures.size());
+  if (!dependencies.empty())
+    append(image, &dependencies[0], dependencies.size());
+  for (unsigned int i = 0; i < model.meshes.size(); i++)
+    if (!model.meshes[i].vertices.empty())
+      append(image, &model.meshes[i].vertices[0], model.meshes[i].vertices.size());
+  image.insert(image.end(), indices.begin(), indices.end());
+  image.insert(image.end(), strings.begin(), strings.end());
+
+  releaseModel(model);
+  return true;
+}
+
+bool ModelCache::valid(const char *data, size_t size, const std::string &path, bool &touched)
+{
+  touched = false;
+  if (size < sizeof(CacheHeader))
+    return false;
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.Magic, "MSHC", 4) != 0 || header.Version != CACHE_VERSION)
+    return false;
+  unsigned long long expected = sizeof(CacheHeader) + (unsigned long long)header.MeshCount * sizeof(CacheMesh) + (unsigned long long)header.MaterialCount * sizeof(CacheMaterial) + (unsigned long long)header.TextureCount * sizeof(CacheTexture) + (unsigned long long)header.DependencyCount * sizeof(CacheDependency) + (unsigned long long)header.VertexCount * sizeof(Vertex) + header.IndexBytes + header.StringBytes;
+  // A truncated or corrupt cache is rebuilt rather than trusted by upload()
+  if (size != expected || !consistent(data, header))
+    return false;
+
+  long long time, sourceSize;
+  if (!sourceInfo(path, time, sourceSize))
+    return true; // the source is gone, the cache is all we have
+  if (sourceSize != header.SourceSize)
+    return false;
+  // An edited material library or texture rebuilds the cache too
+  const CacheDependency *dependencies = (const CacheDependency *)(data + sizeof(CacheHeader) + header.MeshCount * sizeof(CacheMesh) + header.MaterialCount * sizeof(CacheMaterial) + header.TextureCount * sizeof(CacheTexture));
+  const char *strings = data + size - header.StringBytes;
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  for (unsigned int i = 0; i < header.DependencyCount; i++)
+    if (!current(dependencies[i], directory + "/" + (strings + dependencies[i].Path)))
+      return false;
+  if (time == header.SourceTime)
+    return true;
+  // The timestamp moved (copy, checkout), only rebuild if the content changed
+  unsigned long long hash;
+  if (!sourceHash(path, hash) || hash != header.SourceHash)
+    return false;
+  touched = true;
+  return true;
+}
+
+StaticModel ModelCache::upload(const char *data, const std::string &directory)
+{
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  const CacheMesh *meshes = (const CacheMesh *)(data + sizeof(CacheHeader));
+  const CacheMaterial *materials = (const CacheMaterial *)(meshes + header.MeshCount);
+  const CacheTexture *textures = (const CacheTexture *)(materials + header.MaterialCount);
+  const CacheDependency *dependencies = (const CacheDependency *)(textures + header.TextureCount);
+  const char *vertices = (const char *)(dependencies + header.DependencyCount);
+  const char *indices = vertices + (size_t)header.VertexCount * sizeof(Vertex);
+  const char *strings = indices + header.IndexBytes;
+
+  StaticModel model;
+  for (unsigned int i = 0; i < header.MaterialCount; i++)
+  {
+    StaticModel::Material material;
+    for (unsigned int t = 0; t < materials[i].TextureCount; t++)
+    {
+      const CacheTexture &entry = textures[materials[i].FirstTexture + t];
+      Texture texture;
+      texture.type = strings + entry.Type;
+      texture.path = directory + "/" + (strings + entry.Path);
+      // The ResourceManager owns the texture, so it counts against the budget and is evicted like the others
+      if (ResourceManager::Entries.find(texture.path) == ResourceManager::Entries.end())
+      {
+        int width, height, channels = 3;
+        stbi_info(texture.path.c_str(), &width, &height, &channels);
+        ResourceManager::LoadTexture(texture.path.c_str(), channels == 4, texture.path, true);
+      }
+      texture.id = ResourceManager::GetTexture(texture.path).ID;
+      material.Textures.push_back(texture);
+    }
+    model.Materials.push_back(material);
+  }
+  for (unsigned int i = 0; i < header.MeshCount; i++)
+  {
+    StaticModel::SubMesh mesh;
+    mesh.BaseVertex = meshes[i].BaseVertex;
+    mesh.VertexCount = meshes[i].VertexCount;
+    mesh.IndexOffset = meshes[i].IndexOffset;
+    mesh.IndexCount = meshes[i].IndexCount;
+    mesh.IndexType = meshes[i].IndexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh.Material = meshes[i].Material;
+    mesh.Bounds = AABB(glm::vec3(meshes[i].BoundsMin[0], meshes[i].BoundsMin[1], meshes[i].BoundsMin[2]),
+                       glm::vec3(meshes[i].BoundsMax[0], meshes[i].BoundsMax[1], meshes[i].BoundsMax[2]));
+    model.Meshes.push_back(mesh);
+  }
+  model.BuildBatches();
+
+  glGenVertexArrays(1, &model.VAO);
+  glGenBuffers(1, &model.VBO);
+  glGenBuffers(1, &model.EBO);
+  glBindVertexArray(model.VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+  glBufferData(GL_ARRAY_BUFFER, (size_t)header.VertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, header.IndexBytes, indices, GL_STATIC_DRAW);
+  // vertex Positions
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  // vertex normals
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+  // vertex texture coords
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+  // vertex tangent
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+  // vertex bitangent
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+  glBindVertexArray(0);
+  return model;
+}
+
+void StaticModel::BuildBatches()
+{
+  std::map<std::pair<unsigned int, GLenum>, unsigned int> batchIds;
+  std::map<GLenum, unsigned int> depthIds;
+  this->Batches.clear();
+  this->DepthBatches.clear();
+  for (unsigned int i = 0; i < this->Meshes.size(); i++)
+  {
+    const SubMesh &mesh = this->Meshes[i];
+    std::pair<unsigned int, GLenum> key(mesh.Material, mesh.IndexType);
+    if (batchIds.find(key) == batchIds.end())
+    {
+      batchIds[key] = (unsigned int)this->Batches.size();
+      this->Batches.push_back(Batch());
+      this->Batches.back().Material = mesh.Material;
+      this->Batches.back().IndexType = mesh.IndexType;
+    }
+    if (depthIds.find(mesh.IndexType) == depthIds.end())
+    {
+      depthIds[mesh.IndexType] = (unsigned int)this->DepthBatches.size();
+      this->DepthBatches.push_back(Batch());
+      this->DepthBatches.back().Material = 0;
+      this->DepthBatches.back().IndexType = mesh.IndexType;
+    }
+    Batch *targets[2] = {&this->Batches[batchIds[key]], &this->DepthBatches[depthIds[mesh.IndexType]]};
+    for (int b = 0; b < 2; b++)
+    {
+      targets[b]->Counts.push_back(mesh.IndexCount);
+      targets[b]->Offsets.push_back((const void *)mesh.IndexOffset);
+      targets[b]->BaseVertices.push_back(mesh.BaseVertex);
+      targets[b]->MeshIds.push_back(i);
+    }
+  }
+}
+
+void StaticModel::Draw(Shader shader)
+{
+  glBindVertexArray(this->VAO);
+  for (unsigned int i = 0; i < this->Batches.size(); i++)
+  {
+    const Batch &batch = this->Batches[i];
+    this->bindMaterial(shader.ID, this->Materials[batch.Material]);
+    submit(batch);
+  }
+  glBindVertexArray(0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void StaticModel::DrawDepth()
+{
+  glBindVertexArray(this->VAO);
+  for (unsigned int i = 0; i < this->DepthBatches.size(); i++)
+    submit(this->DepthBatches[i]);
+  glBindVertexArray(0);
+}
+
+void StaticModel::Draw(Shader shader, const std::vector<unsigned char> &visible)
+{
+  glBindVertexArray(this->VAO);
+  for (unsigned int i = 0; i < this->Batches.size(); i++)
+  {
+    const Batch &batch = this->Batches[i];
+    if (!this->filter(batch, visible))
+      continue;
+    this->bindMaterial(shader.ID, this->Materials[batch.Material]);
+    submit(this->Visible);
+  }
+  glBindVertexArray(0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void StaticModel::DrawDepth(const std::vector<unsigned char> &visible)
+{
+  glBindVertexArray(this->VAO);
+  for (unsigned int i = 0; i < this->DepthBatches.size(); i++)
+    if (this->filter(this->DepthBatches[i], visible))
+      submit(this->Visible);
+  glBindVertexArray(0);
+}
+
+bool StaticModel::filter(const Batch &batch, const std::vector<unsigned char> &visible)
+{
+  // Reuses the scratch batch so culling does not allocate every frame
+  this->Visible.IndexType = batch.IndexType;
+  this->Visible.Counts.clear();
+  this->Visible.Offsets.clear();
+  this->Visible.BaseVertices.clear();
+  for (unsigned int i = 0; i < batch.MeshIds.size(); i++)
+  {
+    if (!visible[batch.MeshIds[i]])
+      continue;
+    this->Visible.Counts.push_back(batch.Counts[i]);
+    this->Visible.Offsets.push_back(batch.Offsets[i]);
+    this->Visible.BaseVertices.push_back(batch.BaseVertices[i]);
+  }
+  return !this->Visible.Counts.empty();
+}
+
+void StaticModel::submit(const Batch &batch)
+{
+  if (batch.Counts.empty())
+    return;
+  glMultiDrawElementsBaseVertex(GL_TRIANGLES, &batch.Counts[0], batch.IndexType, &batch.Offsets[0], (GLsizei)batch.Counts.size(), &batch.BaseVertices[0]);
+}
+
+void StaticModel::bindMaterial(GLuint program, const Material &material)
+{
+  // Each texture type has a fixed unit, only the first texture of a type is used by model.fs
+  static const char *types[4] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_ambient"};
+  UniformLocation *samplers[4] = {&this->DiffuseSampler, &this->SpecularSampler, &this->NormalSampler, &this->AmbientSampler};
+  UniformLocation *flags[4] = {&this->HasDiffuse, &this->HasSpecular, &this->HasNormal, &this->HasAmbient};
+  for (int unit = 0; unit < 4; unit++)
+  {
+    bool found = false;
+    for (unsigned int t = 0; t < material.Textures.size() && !found; t++)
+    {
+      if (material.Textures[t].type != types[unit])
+        continue;
+      glActiveTexture(GL_TEXTURE0 + unit);
+      // by name, the texture may have been evicted and reloaded under a new id
+      ResourceManager::GetTexture(material.Textures[t].path).Bind();
+      found = true;
+    }
+    glUniform1i(samplers[unit]->Get(program), unit);
+    glUniform1i(flags[unit]->Get(program), found);
+  }
+}
+
+void StaticModel::Release()
+{
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteBuffers(1, &this->VBO);
+  glDeleteBuffers(1, &this->EBO);
+  this->VAO = this->VBO = this->EBO = 0;
+  for (unsigned int i = 0; i < this->Materials.size(); i++)
+    for (unsigned int t = 0; t < this->Materials[i].Textures.size(); t++)
+      ResourceManager::Evict(this->Materials[i].Textures[t].path);
+  this->Materials.clear();
+}
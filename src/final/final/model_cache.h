@@ -0,0 +1,103 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/mesh.h>
+
+#include "frame_uniforms.h"
+#include "culling.h"
+
+// A static model ready for drawing: every mesh of the source file lives in
+// one interleaved vertex buffer and one index buffer behind a single VAO.
+// Meshes keep their own 16 or 32 bit indices. At load time meshes sharing a
+// material are merged into batches that are submitted with a single
+// glMultiDrawElementsBaseVertex, so a pass costs one draw per material
+// (one draw in total for depth-only passes) instead of one per mesh.
+class StaticModel
+{
+public:
+  struct SubMesh
+  {
+    GLint BaseVertex;
+    GLuint VertexCount;
+    size_t IndexOffset; // byte offset into the index buffer
+    GLsizei IndexCount;
+    GLenum IndexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int Material;
+    AABB Bounds;        // model space
+  };
+  // Textures of one material, Texture.type is e.g. "texture_diffuse" and
+  // Texture.path the image's file, its name in the ResourceManager
+  struct Material
+  {
+    std::vector<Texture> Textures;
+  };
+  // Meshes drawn together by one multi-draw call
+  struct Batch
+  {
+    unsigned int Material;
+    GLenum IndexType;
+    std::vector<GLsizei> Counts;
+    std::vector<const void *> Offsets;
+    std::vector<GLint> BaseVertices;
+    std::vector<unsigned int> MeshIds; // index into Meshes of every draw
+  };
+
+  std::vector<SubMesh> Meshes;
+  std::vector<Material> Materials;
+  std::vector<Batch> Batches;      // one per material and index type
+  std::vector<Batch> DepthBatches; // one per index type, materials ignored
+  unsigned int VAO, VBO, EBO;
+
+  StaticModel() : VAO(0), VBO(0), EBO(0), DiffuseSampler("texture_diffuse1"), SpecularSampler("texture_specular1"), NormalSampler("texture_normal1"), AmbientSampler("texture_ambient1"), HasDiffuse("hasDiffuseTexture"), HasSpecular("hasSpecularTexture"), HasNormal("hasNormalTexture"), HasAmbient("hasAmbientTexture") {}
+  // Groups Meshes into Batches and DepthBatches, call after Meshes changed
+  void BuildBatches();
+  // Draws every mesh with its material's textures bound
+  void Draw(Shader shader);
+  // Draws every mesh without touching textures or material uniforms, for depth-only passes
+  void DrawDepth();
+  // Same as above, only meshes i with visible[i] != 0 are drawn
+  void Draw(Shader shader, const std::vector<unsigned char> &visible);
+  void DrawDepth(const std::vector<unsigned char> &visible);
+  // Deletes the GL buffers and evicts the textures from the ResourceManager
+  void Release();
+
+private:
+  UniformLocation DiffuseSampler, SpecularSampler, NormalSampler, AmbientSampler;
+  UniformLocation HasDiffuse, HasSpecular, HasNormal, HasAmbient;
+  Batch Visible; // scratch batch of the culled draws
+  void bindMaterial(GLuint program, const Material &material);
+  bool filter(const Batch &batch, const std::vector<unsigned char> &visible);
+  static void submit(const Batch &batch);
+};
+
+// ModelCache turns Assimp-loaded models into a compact binary file stored
+// next to the asset (<model>.meshcache): vertices are interleaved in the
+// layout of learnopengl's Vertex, indices use 16 bits whenever a mesh has
+// at most 65536 vertices, and materials reference texture paths through
+// a string table. Later runs memory-map the cache and upload it as is.
+// The cache is rebuilt when the source's size and modification time change
+// and its content hash no longer matches, or when a material library or
+// texture it was built from changed its size or modification time. Textures are loaded through the
+// ResourceManager, mipmapped, so they count against its memory budget.
+class ModelCache
+{
+public:
+  // Loads a model through the cache, parsing it with Assimp on a miss
+  static StaticModel Load(const std::string &path);
+
+private:
+  ModelCache() {}
+  // Serializes the Assimp model at path into a cache image
+  static bool build(const std::string &path, std::vector<char> &image);
+  // Validates a cache image's layout and its header against the source file
+  static bool valid(const char *data, size_t size, const std::string &path, bool &touched);
+  // Creates GL objects and loads textures from a validated cache image
+  static StaticModel upload(const char *data, const std::string &directory);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include "resource_manager.h"
+#include "frame_uniforms.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -11,8 +12,12 @@ class Object
 public:
   glm::vec3 Position, Size;
   glm::vec3 Color;
+  // Cached location of the "model" uniform, set on every draw
+  UniformLocation ModelLocation;
   Object::Object(glm::vec3 pos, glm::vec3 size, glm::vec3 color)
-    : Position(pos), Size(size), Color(color) {}
+    : Position(pos), Size(size), Color(color), ModelLocation("model") {}
+  // Scattered grass patches are deleted through base class pointers
+  virtual ~Object() {}
   // Draw sprite
   virtual void Draw();
   virtual void InitRenderData();
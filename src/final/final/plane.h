@@ -3,10 +3,13 @@
 
 #include <string>
 #include <vector>
+#include <iostream>
 
 #include <stb_image.h>
 
 #include "object.h"
+#include "terrain_normals.h"
+#include "util.h"
 
 class Plane : public Object
 {
@@ -18,14 +21,15 @@ class Plane : public Object
   };
 
 public:
-  Plane(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const char *file) : Object(pos, size, color)
+  Plane(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const char *file) : Object(pos, size, color), VAO(0), VBO(0), EBO(0), size(0), IndexType(GL_UNSIGNED_INT)
   {
     this->InitRenderData(file);
   };
   ~Plane(){};
 
-  unsigned int VAO;
-  int size;
+  unsigned int VAO, VBO, EBO;
+  int size;         // number of indices
+  GLenum IndexType; // GL_UNSIGNED_SHORT up to 65536 vertices, GL_UNSIGNED_INT beyond
 
   void Draw(Shader *shader)
   {
@@ -33,80 +37,99 @@ public:
     glm::mat4 model(1.0f);
     model = glm::translate(model, this->Position);
     model = glm::scale(model, this->Size);
-    shader->setMat4("model", model);
+    glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
     glBindVertexArray(this->VAO);
-    glDrawArrays(GL_TRIANGLES, 0, this->size);
+    glDrawElements(GL_TRIANGLES, this->size, this->IndexType, (void *)0);
     glBindVertexArray(0);
   }
 
+  // Builds an indexed grid with one vertex per heightmap texel, shared by
+  // the (up to) six triangles around it
   void InitRenderData(const char *file)
   {
     int width, height;
     unsigned char *image = stbi_load(file, &width, &height, 0, STBI_grey);
-    // Now generate texture
-    std::vector<Vertex> vertices;
-
-    for (int i = 0; i < height - 1; i++)
-    {
-      for (int k = 0; k < width - 1; k++)
-      {
-        glm::vec3 v1(k + 0, static_cast<float>(image[k + i * height]), i + 0);
-        glm::vec3 v2(k + 0, static_cast<float>(image[k + (i + 1) * height]), i + 1);
-        glm::vec3 v3(k + 1, static_cast<float>(image[(k + 1)  + (i + 1) * height]), i + 1);
-        glm::vec3 v4(k + 1, static_cast<float>(image[(k + 1) + i * height]), i + 0);
-        Vertex t1, t2, t3, t4;
-        t1.Position = v1;
-        t2.Position = v2;
-        t3.Position = v3;
-        t4.Position = v4;
-		auto n1 = glm::cross(v2 - v1, v3 - v1), n2 = glm::cross(v3-v1, v4-v1);
-		t1.Normal = glm::normalize(n1 + n2);
-		t2.Normal = glm::normalize(n1);
-		t3.Normal = glm::normalize(n1 + n2);
-		t4.Normal = glm::normalize(n2);
-        vertices.push_back(t1);
-        vertices.push_back(t2);
-        vertices.push_back(t3);
-        vertices.push_back(t1);
-        vertices.push_back(t3);
-        vertices.push_back(t4);
-      }
-    }
-
-    this->size = vertices.size();
-    for (int i = 0; i < vertices.size(); i++)
+    if (!image)
     {
-      glm::vec2 tmp(vertices[i].Position.x / width, vertices[i].Position.z / height);
-      vertices[i].TextCoords = tmp;
+      std::cout << "ERROR::PLANE: Failed to load heightmap " << file << std::endl;
+      return;
     }
 
-	glm::vec3 acc = glm::vec3(0);
-	for (int i = 0; i < 9; i++) {
-		acc += vertices[i].Normal;
-	}
-
-	for (int i = 4; i < vertices.size() - 4; i++)
-	{
-		
-		vertices[i].Normal = glm::normalize(acc);
-		acc -= vertices[i - 4].Normal;
-		acc += vertices[i + 4].Normal;
-	}
-
+    std::vector<Vertex> vertices((size_t)width * height);
+    parallel_for(height, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+        for (int k = 0; k < width; k++)
+        {
+          Vertex &vertex = vertices[k + (size_t)i * width];
+          vertex.Position = glm::vec3(k, static_cast<float>(image[k + i * width]), i);
+          vertex.TextCoords = glm::vec2((float)k / width, (float)i / height);
+        }
+      }
+    });
+    // Sobel normals straight from the heightmap grid
+    TerrainNormals::Generate(image, width, height, &vertices[0].Normal, NULL, sizeof(Vertex));
     stbi_image_free(image);
 
-    unsigned int VBO;
     glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glGenBuffers(1, &this->VBO);
+    glGenBuffers(1, &this->EBO);
+    glBindVertexArray(this->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+    if (vertices.size() <= 65536)
+    {
+      this->IndexType = GL_UNSIGNED_SHORT;
+      uploadIndices<unsigned short>(width, height);
+    }
+    else
+    {
+      this->IndexType = GL_UNSIGNED_INT;
+      uploadIndices<unsigned int>(width, height);
+    }
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
 	glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TextCoords));
 	glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+    glBindVertexArray(0);
+  }
+
+  // Deletes the GL objects
+  void Release()
+  {
+    glDeleteVertexArrays(1, &this->VAO);
+    glDeleteBuffers(1, &this->VBO);
+    glDeleteBuffers(1, &this->EBO);
+    this->VAO = this->VBO = this->EBO = 0;
+  }
+
+private:
+  // Two triangles per quad of the grid, wound as the terrain always was, into
+  // the bound element buffer
+  template <typename Index>
+  void uploadIndices(int width, int height)
+  {
+    std::vector<Index> indices;
+    indices.reserve((size_t)(width - 1) * (height - 1) * 6);
+    for (int i = 0; i < height - 1; i++)
+    {
+      for (int k = 0; k < width - 1; k++)
+      {
+        Index v1 = (Index)(k + i * width), v2 = (Index)(k + (i + 1) * width);
+        Index v3 = (Index)((k + 1) + (i + 1) * width), v4 = (Index)((k + 1) + i * width);
+        indices.push_back(v1);
+        indices.push_back(v2);
+        indices.push_back(v3);
+        indices.push_back(v1);
+        indices.push_back(v3);
+        indices.push_back(v4);
+      }
+    }
+    this->size = indices.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(Index), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
   }
 };
 
@@ -7,99 +7,260 @@
 ** option) any later version.
 ******************************************************************/
 #include "resource_manager.h"
+#include "shader_cache.h"
+#include "frame_uniforms.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 
 #include <stb_image.h>
 
 // Instantiate static variables
 std::map<std::string, Texture2D> ResourceManager::Textures;
 std::map<std::string, Shader> ResourceManager::Shaders;
+std::map<std::string, ResourceEntry> ResourceManager::Entries;
+size_t ResourceManager::Budget = 0;
+size_t ResourceManager::Resident = 0;
+unsigned long ResourceManager::Frame = 0;
 
-Shader ResourceManager::LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name)
+Shader ResourceManager::LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name, std::string defines)
 {
-  Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
+  Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile, defines);
   return Shaders[name];
 }
 
+Shader ResourceManager::LoadTessellationShader(const char *vShaderFile, const char *tcShaderFile, const char *teShaderFile, const char *fShaderFile, std::string name, std::string defines)
+{
+  std::string vertexCode, controlCode, evaluationCode, fragmentCode;
+  try
+  {
+    vertexCode = insertDefines(readShaderFile(vShaderFile), defines);
+    controlCode = insertDefines(readShaderFile(tcShaderFile), defines);
+    evaluationCode = insertDefines(readShaderFile(teShaderFile), defines);
+    fragmentCode = insertDefines(readShaderFile(fShaderFile), defines);
+  }
+  catch (std::ifstream::failure e)
+  {
+    std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
+  }
+  Shader shader;
+  shader.ID = ShaderCache::LoadTessellationProgram(vertexCode, controlCode, evaluationCode, fragmentCode);
+  FrameUniforms::Attach(shader.ID);
+  Shaders[name] = shader;
+  return shader;
+}
+
+Shader ResourceManager::LoadComputeShader(const char *cShaderFile, std::string name, std::string defines)
+{
+  std::string computeCode;
+  try
+  {
+    computeCode = insertDefines(readShaderFile(cShaderFile), defines);
+  }
+  catch (std::ifstream::failure e)
+  {
+    std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
+  }
+  Shader shader;
+  shader.ID = ShaderCache::LoadComputeProgram(computeCode);
+  FrameUniforms::Attach(shader.ID);
+  Shaders[name] = shader;
+  return shader;
+}
+
 Shader ResourceManager::GetShader(std::string name)
 {
   return Shaders[name];
 }
 
-Texture2D ResourceManager::LoadTexture(const GLchar *file, GLboolean alpha, std::string name)
+Texture2D ResourceManager::LoadTexture(const GLchar *file, GLboolean alpha, std::string name, GLboolean mipmap)
 {
-  Textures[name] = loadTextureFromFile(file, alpha);
+  ResourceEntry &entry = Entries[name];
+  if (entry.Resident)
+    Evict(name);
+  entry.Cubemap = false;
+  entry.Alpha = alpha;
+  entry.Mipmap = mipmap;
+  entry.Files = std::vector<std::string>(1, file);
+  reload(name, entry);
+  trim();
+  return Textures[name];
+}
+
+Texture2D ResourceManager::LoadMaskedTexture(const GLchar *file, const GLchar *alphaFile, std::string name)
+{
+  ResourceEntry &entry = Entries[name];
+  if (entry.Resident)
+    Evict(name);
+  entry.Cubemap = false;
+  entry.Alpha = true;
+  entry.Mipmap = false;
+  entry.Files = std::vector<std::string>(1, file);
+  entry.Files.push_back(alphaFile);
+  reload(name, entry);
+  trim();
+  return Textures[name];
+}
+
+Texture2D ResourceManager::LoadCubemap(std::vector<std::string> faces, std::string name)
+{
+  ResourceEntry &entry = Entries[name];
+  if (entry.Resident)
+    Evict(name);
+  entry.Cubemap = true;
+  entry.Alpha = false;
+  entry.Mipmap = false;
+  entry.Files = faces;
+  reload(name, entry);
+  trim();
   return Textures[name];
 }
 
 Texture2D ResourceManager::GetTexture(std::string name)
 {
+  auto iter = Entries.find(name);
+  if (iter == Entries.end())
+    return Textures[name];
+  if (!iter->second.Resident)
+  {
+    reload(name, iter->second);
+    trim();
+  }
+  iter->second.LastUsed = Frame;
   return Textures[name];
 }
 
+void ResourceManager::SetMemoryBudget(size_t bytes)
+{
+  Budget = bytes;
+  trim();
+}
+
+size_t ResourceManager::ResidentBytes()
+{
+  return Resident;
+}
+
+void ResourceManager::NextFrame()
+{
+  Frame++;
+  trim();
+}
+
+void ResourceManager::Evict(std::string name)
+{
+  auto iter = Entries.find(name);
+  if (iter == Entries.end() || !iter->second.Resident)
+    return;
+  Textures[name].Release();
+  Resident -= iter->second.Bytes;
+  iter->second.Resident = false;
+}
+
+void ResourceManager::Acquire(std::string name)
+{
+  if (!name.empty())
+    Entries[name].Refs++;
+}
+
+void ResourceManager::Release(std::string name)
+{
+  auto iter = Entries.find(name);
+  if (iter != Entries.end() && iter->second.Refs > 0)
+    iter->second.Refs--;
+}
+
 void ResourceManager::Clear()
 {
   // (Properly) delete all shaders
   for (auto iter : Shaders)
     glDeleteProgram(iter.second.ID);
   // (Properly) delete all textures
-  for (auto iter : Textures)
-    glDeleteTextures(1, &iter.second.ID);
+  for (auto &iter : Textures)
+    iter.second.Release();
+  Shaders.clear();
+  Textures.clear();
+  Entries.clear();
+  Resident = 0;
 }
 
-Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile)
+Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, const std::string &defines)
 {
-  // 1. Retrieve the vertex/fragment source code from filePath
+  // 1. Retrieve the vertex/fragment source code from filePath, with includes expanded
   std::string vertexCode;
   std::string fragmentCode;
   std::string geometryCode;
-  std::ifstream vertexShaderFile;
-  std::ifstream fragmentShaderFile;
-  std::ifstream geometryShaderFile;
-  vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  fragmentShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  geometryShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
   try
   {
-    // Open files
-    vertexShaderFile.open(vShaderFile);
-    fragmentShaderFile.open(fShaderFile);
-    std::stringstream vShaderStream, fShaderStream;
-    // Read file's buffer contents into streams
-    vShaderStream << vertexShaderFile.rdbuf();
-    fShaderStream << fragmentShaderFile.rdbuf();
-    // close file handlers
-    vertexShaderFile.close();
-    fragmentShaderFile.close();
-    // Convert stream into string
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
+    vertexCode = insertDefines(readShaderFile(vShaderFile), defines);
+    fragmentCode = insertDefines(readShaderFile(fShaderFile), defines);
     // If geometry shader path is present, also load a geometry shader
     if (gShaderFile != nullptr)
-    {
-      geometryShaderFile.open(gShaderFile);
-      std::stringstream gShaderStream;
-      gShaderStream << geometryShaderFile.rdbuf();
-      geometryShaderFile.close();
-      geometryCode = gShaderStream.str();
-    }
+      geometryCode = insertDefines(readShaderFile(gShaderFile), defines);
   }
   catch (std::ifstream::failure e)
   {
     std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
   }
-  const char *vShaderCode = vertexCode.c_str();
-  const char *fShaderCode = fragmentCode.c_str();
-  const char *gShaderCode = geometryCode.c_str();
-  // 2. Now create shader object from source code
-  Shader shader(vShaderFile, fShaderFile, gShaderFile);
+  // 2. Now create shader object from source code, reusing the cached program binary when possible
+  Shader shader;
+  shader.ID = ShaderCache::LoadProgram(vertexCode, fragmentCode, geometryCode);
+  FrameUniforms::Attach(shader.ID);
   return shader;
 }
 
-Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alpha)
+std::string ResourceManager::readShaderFile(const std::string &path, int depth)
+{
+  std::ifstream shaderFile;
+  shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+  shaderFile.open(path.c_str());
+  std::stringstream shaderStream;
+  shaderStream << shaderFile.rdbuf();
+  shaderFile.close();
+  std::string source = shaderStream.str();
+  if (source.find("#include") == std::string::npos)
+    return source;
+
+  std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+  std::string code, line;
+  std::istringstream lines(source);
+  while (std::getline(lines, line))
+  {
+    size_t start = line.find_first_not_of(" \t");
+    if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+    {
+      size_t open = line.find('"', start);
+      size_t close = line.find('"', open + 1);
+      if (open == std::string::npos || close == std::string::npos || depth >= 8)
+      {
+        std::cout << "ERROR::SHADER: Bad #include in " << path << ": " << line << std::endl;
+        continue;
+      }
+      code += readShaderFile(directory + line.substr(open + 1, close - open - 1), depth + 1) + "\n";
+      continue;
+    }
+    code += line + "\n";
+  }
+  return code;
+}
+
+std::string ResourceManager::insertDefines(const std::string &code, const std::string &defines)
+{
+  if (defines.empty())
+    return code;
+  // #version must stay the first line
+  size_t version = code.find("#version");
+  if (version == std::string::npos)
+    return defines + code;
+  size_t end = code.find('\n', version);
+  if (end == std::string::npos)
+    return code + "\n" + defines;
+  return code.substr(0, end + 1) + defines + code.substr(end + 1);
+}
+
+Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alpha, GLboolean mipmap)
 {
   // Create Texture object
   Texture2D texture;
@@ -108,6 +269,8 @@ Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alp
     texture.Internal_Format = GL_RGBA;
     texture.Image_Format = GL_RGBA;
   }
+  if (mipmap)
+    texture.Filter_Min = GL_LINEAR_MIPMAP_LINEAR;
   // Load image
   int width, height;
   unsigned char *image = stbi_load(file, &width, &height, 0, texture.Image_Format == GL_RGBA ? STBI_rgb_alpha : STBI_rgb);
@@ -116,4 +279,110 @@ Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alp
   // And finally free image data
   stbi_image_free(image);
   return texture;
+}
+
+Texture2D ResourceManager::loadMaskedTextureFromFile(const GLchar *file, const GLchar *alphaFile)
+{
+  Texture2D texture;
+  texture.Internal_Format = GL_RGBA;
+  texture.Image_Format = GL_RGBA;
+  int width = 0, height = 0, maskWidth = 0, maskHeight = 0;
+  unsigned char *image = stbi_load(file, &width, &height, 0, STBI_rgb_alpha);
+  unsigned char *mask = stbi_load(alphaFile, &maskWidth, &maskHeight, 0, STBI_grey);
+  if (image && mask)
+  {
+    // nearest texel of the mask, it may have another size than the image
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+        image[(x + y * width) * 4 + 3] = mask[(x * maskWidth / width) + (y * maskHeight / height) * maskWidth];
+  }
+  else
+    std::cout << "ERROR::TEXTURE: Failed to load " << (image ? alphaFile : file) << std::endl;
+  texture.Generate(width, height, image);
+  stbi_image_free(image);
+  stbi_image_free(mask);
+  return texture;
+}
+
+Texture2D ResourceManager::loadCubemapFromFile(const std::vector<std::string> &faces)
+{
+  Texture2D texture;
+  glGenTextures(1, &texture.ID);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture.ID);
+
+  int width, height, nrChannels;
+  for (unsigned int i = 0; i < faces.size(); i++)
+  {
+    unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+    if (data)
+    {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      texture.Width = width;
+      texture.Height = height;
+      stbi_image_free(data);
+    }
+    else
+    {
+      std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+      stbi_image_free(data);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  return texture;
+}
+
+void ResourceManager::reload(const std::string &name, ResourceEntry &entry)
+{
+  if (entry.Files.empty())
+    return;
+  Texture2D texture;
+  if (entry.Cubemap)
+    texture = loadCubemapFromFile(entry.Files);
+  else if (entry.Files.size() == 2)
+    texture = loadMaskedTextureFromFile(entry.Files[0].c_str(), entry.Files[1].c_str());
+  else
+    texture = loadTextureFromFile(entry.Files[0].c_str(), entry.Alpha, entry.Mipmap);
+  Textures[name] = texture;
+  // RGB textures are usually padded to 4 bytes per texel by the driver
+  size_t texels = 0;
+  int levels = texture.Mipmapped() ? 32 : 1;
+  for (int level = 0; level < levels; level++)
+  {
+    int width = std::max(texture.Width >> level, 1), height = std::max(texture.Height >> level, 1);
+    texels += (size_t)width * height;
+    if (width == 1 && height == 1)
+      break;
+  }
+  entry.Bytes = texels * 4 * (entry.Cubemap ? 6 : 1);
+  entry.Resident = true;
+  entry.LastUsed = Frame;
+  Resident += entry.Bytes;
+}
+
+void ResourceManager::trim()
+{
+  while (Budget != 0 && Resident > Budget)
+  {
+    // Find the least recently used texture that may be evicted
+    std::map<std::string, ResourceEntry>::iterator victim = Entries.end();
+    for (auto iter = Entries.begin(); iter != Entries.end(); ++iter)
+    {
+      const ResourceEntry &entry = iter->second;
+      if (!entry.Resident || entry.Refs > 0 || entry.LastUsed >= Frame)
+        continue;
+      if (victim == Entries.end() || entry.LastUsed < victim->second.LastUsed)
+        victim = iter;
+    }
+    if (victim == Entries.end())
+      break;
+    Evict(victim->first);
+  }
 }
\ No newline at end of file
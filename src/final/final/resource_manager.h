@@ -11,39 +11,117 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "texture.h"
 #include <learnopengl/shader.h>
 
+// Bookkeeping the ResourceManager keeps next to every cached texture:
+// how much GPU memory it holds, when it was last used, how many handles
+// pin it and where to load it from again once it has been evicted.
+struct ResourceEntry
+{
+  size_t Bytes;                   // Estimated GPU memory of the texture
+  unsigned long LastUsed;         // Frame number of the last Get
+  int Refs;                       // Live TextureHandles, pinned while > 0
+  bool Resident;                  // False once evicted, reloaded on next Get
+  bool Cubemap;                   // Files holds six cubemap faces
+  GLboolean Alpha;                // Load with an alpha channel
+  GLboolean Mipmap;               // Generate a mip chain
+  std::vector<std::string> Files; // Source image(s), for a masked texture the image and its alpha mask
+  ResourceEntry() : Bytes(0), LastUsed(0), Refs(0), Resident(false), Cubemap(false), Alpha(false), Mipmap(false) {}
+};
+
 // A static singleton ResourceManager class that hosts several
 // functions to load Textures and Shaders. Each loaded texture
 // and/or shader is also stored for future reference by string
 // handles. All functions and resources are static and no
 // public constructor is defined.
+// Textures are tracked against a GPU memory budget: when the resident
+// size exceeds it, the least recently used textures that are not pinned
+// by a TextureHandle are deleted and transparently reloaded on next use.
 class ResourceManager
 {
 public:
   // Resource storage
   static std::map<std::string, Shader> Shaders;
   static std::map<std::string, Texture2D> Textures;
+  static std::map<std::string, ResourceEntry> Entries;
   // Loads (and generates) a shader program from file loading vertex, fragment (and geometry) shader's source code. If gShaderFile is not nullptr, it also loads a geometry shader
-  static Shader LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name);
+  // #include "file" lines are expanded relative to the including file. Defines (e.g. "#define SHADOW_KERNEL 4\n") are inserted after #version in every stage to build variants
+  static Shader LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name, std::string defines = "");
+  // Loads (and generates) a shader program with tessellation control and evaluation stages from file, with the same #include and define handling (GL 4.0)
+  static Shader LoadTessellationShader(const char *vShaderFile, const char *tcShaderFile, const char *teShaderFile, const char *fShaderFile, std::string name, std::string defines = "");
+  // Loads (and generates) a compute shader program from file, with the same #include and define handling (GL 4.3)
+  static Shader LoadComputeShader(const char *cShaderFile, std::string name, std::string defines = "");
   // Retrieves a stored sader
   static Shader GetShader(std::string name);
-  // Loads (and generates) a texture from file
-  static Texture2D LoadTexture(const GLchar *file, GLboolean alpha, std::string name);
-  // Retrieves a stored texture
+  // Loads (and generates) a texture from file, with a trilinear filtered mip chain if mipmap is set
+  static Texture2D LoadTexture(const GLchar *file, GLboolean alpha, std::string name, GLboolean mipmap = false);
+  // Loads (and generates) an RGBA texture whose alpha is the red channel of a second (mask) image
+  static Texture2D LoadMaskedTexture(const GLchar *file, const GLchar *alphaFile, std::string name);
+  // Loads (and generates) a cubemap texture from six face images (+X, -X, +Y, -Y, +Z, -Z)
+  static Texture2D LoadCubemap(std::vector<std::string> faces, std::string name);
+  // Retrieves a stored texture, reloading it if it was evicted
   static Texture2D GetTexture(std::string name);
+  // Sets the texture memory budget in bytes (0 disables eviction)
+  static void SetMemoryBudget(size_t bytes);
+  // Total bytes of all resident textures
+  static size_t ResidentBytes();
+  // Advances the LRU clock and evicts textures until the budget is met. Call once per frame
+  static void NextFrame();
+  // Deletes the GL texture but keeps the entry so it can be reloaded
+  static void Evict(std::string name);
+  // Pins/unpins a texture, used by TextureHandle
+  static void Acquire(std::string name);
+  static void Release(std::string name);
   // Properly de-allocates all loaded resources
   static void Clear();
 
 private:
   // Private constructor, that is we do not want any actual resource manager objects. Its members and functions should be publicly available (static).
   ResourceManager() {}
+  static size_t Budget;
+  static size_t Resident;
+  static unsigned long Frame;
   // Loads and generates a shader from file
-  static Shader loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile = nullptr);
+  static Shader loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile = nullptr, const std::string &defines = "");
+  // Reads a shader source and expands its #include lines
+  static std::string readShaderFile(const std::string &path, int depth = 0);
+  // Inserts the defines after the #version line
+  static std::string insertDefines(const std::string &code, const std::string &defines);
   // Loads a single texture from file
-  static Texture2D loadTextureFromFile(const GLchar *file, GLboolean alpha);
+  static Texture2D loadTextureFromFile(const GLchar *file, GLboolean alpha, GLboolean mipmap);
+  // Loads an image as RGBA and takes the alpha from the red channel of a mask image
+  static Texture2D loadMaskedTextureFromFile(const GLchar *file, const GLchar *alphaFile);
+  // Loads six images into a cubemap texture
+  static Texture2D loadCubemapFromFile(const std::vector<std::string> &faces);
+  // (Re)creates the GL texture of an entry from its source files
+  static void reload(const std::string &name, ResourceEntry &entry);
+  // Evicts least recently used, unpinned textures not used this frame until within budget
+  static void trim();
+};
+
+// Reference counted handle to a cached texture. While any handle to a
+// texture is alive the texture is never evicted.
+class TextureHandle
+{
+public:
+  TextureHandle() {}
+  TextureHandle(std::string name) : Name(name) { ResourceManager::Acquire(this->Name); }
+  TextureHandle(const TextureHandle &other) : Name(other.Name) { ResourceManager::Acquire(this->Name); }
+  TextureHandle &operator=(const TextureHandle &other)
+  {
+    ResourceManager::Acquire(other.Name);
+    ResourceManager::Release(this->Name);
+    this->Name = other.Name;
+    return *this;
+  }
+  ~TextureHandle() { ResourceManager::Release(this->Name); }
+  // Retrieves the texture, reloading it if needed
+  Texture2D Get() const { return ResourceManager::GetTexture(this->Name); }
+
+  std::string Name;
 };
 
-#endif
\ No newline at end of file
+#endif
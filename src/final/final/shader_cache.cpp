@@ -0,0 +1,267 @@
+#include "shader_cache.h"
+#include "util.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Instantiate static variables
+std::string ShaderCache::Directory = "shader_cache";
+int ShaderCache::Hits = 0;
+int ShaderCache::Misses = 0;
+
+namespace
+{
+  // File layout: header followed by Length bytes of driver specific binary
+  struct BinaryHeader
+  {
+    char Magic[4];          // "GLPB"
+    unsigned long long Key; // hash of sources and driver strings
+    GLenum Format;          // binary format reported by glGetProgramBinary
+    GLint Length;           // size of the binary in bytes
+  };
+
+  void hashString(unsigned long long &h, const char *str)
+  {
+    // Hash the terminator too so ("ab", "c") and ("a", "bc") differ
+    if (str)
+      h = hash_bytes(str, strlen(str) + 1, h);
+    else
+      h = hash_bytes("", 1, h);
+  }
+}
+
+GLuint ShaderCache::LoadProgram(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode)
+{
+  if (!supported())
+    return link(vShaderCode, fShaderCode, gShaderCode);
+
+  unsigned long long key = hash(vShaderCode, fShaderCode, gShaderCode);
+  GLuint program = loadBinary(key);
+  if (program != 0)
+  {
+    Hits++;
+    return program;
+  }
+  Misses++;
+  program = link(vShaderCode, fShaderCode, gShaderCode);
+  if (program != 0)
+    storeBinary(key, program);
+  return program;
+}
+
+GLuint ShaderCache::LoadTessellationProgram(const std::string &vShaderCode, const std::string &tcShaderCode, const std::string &teShaderCode,
+                                            const std::string &fShaderCode)
+{
+  if (!supported())
+    return link(vShaderCode, fShaderCode, std::string(), tcShaderCode, teShaderCode);
+
+  unsigned long long key = hash(vShaderCode, fShaderCode, std::string(), tcShaderCode, teShaderCode);
+  GLuint program = loadBinary(key);
+  if (program != 0)
+  {
+    Hits++;
+    return program;
+  }
+  Misses++;
+  program = link(vShaderCode, fShaderCode, std::string(), tcShaderCode, teShaderCode);
+  if (program != 0)
+    storeBinary(key, program);
+  return program;
+}
+
+GLuint ShaderCache::LoadComputeProgram(const std::string &cShaderCode)
+{
+  if (!supported())
+    return linkCompute(cShaderCode);
+
+  // a graphics program always has a vertex shader, so the keys cannot clash
+  unsigned long long key = hash(std::string(), std::string(), cShaderCode);
+  GLuint program = loadBinary(key);
+  if (program != 0)
+  {
+    Hits++;
+    return program;
+  }
+  Misses++;
+  program = linkCompute(cShaderCode);
+  if (program != 0)
+    storeBinary(key, program);
+  return program;
+}
+
+unsigned long long ShaderCache::hash(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode,
+                                     const std::string &tcShaderCode, const std::string &teShaderCode)
+{
+  unsigned long long h = hash_bytes(NULL, 0);
+  hashString(h, (const char *)glGetString(GL_VENDOR));
+  hashString(h, (const char *)glGetString(GL_RENDERER));
+  hashString(h, (const char *)glGetString(GL_VERSION));
+  hashString(h, vShaderCode.c_str());
+  hashString(h, fShaderCode.c_str());
+  hashString(h, gShaderCode.c_str());
+  if (!tcShaderCode.empty() || !teShaderCode.empty())
+  {
+    hashString(h, tcShaderCode.c_str());
+    hashString(h, teShaderCode.c_str());
+  }
+  return h;
+}
+
+std::string ShaderCache::pathFor(unsigned long long key)
+{
+  std::stringstream name;
+  name << Directory << "/" << std::hex << key << ".bin";
+  return name.str();
+}
+
+bool ShaderCache::supported()
+{
+  if (!GLAD_GL_VERSION_4_1 || glProgramBinary == NULL || glGetProgramBinary == NULL)
+    return false;
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+GLuint ShaderCache::loadBinary(unsigned long long key)
+{
+  std::ifstream file(pathFor(key).c_str(), std::ios::binary);
+  if (!file)
+    return 0;
+  BinaryHeader header;
+  if (!file.read((char *)&header, sizeof(header)) || std::string(header.Magic, 4) != "GLPB" || header.Key != key || header.Length <= 0)
+    return 0;
+  std::vector<char> binary(header.Length);
+  if (!file.read(&binary[0], header.Length))
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.Format, &binary[0], header.Length);
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    // The driver rejected the binary, compile from source and overwrite it
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void ShaderCache::storeBinary(unsigned long long key, GLuint program)
+{
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  BinaryHeader header = {{'G', 'L', 'P', 'B'}, key, 0, 0};
+  std::vector<char> binary(length);
+  glGetProgramBinary(program, length, &header.Length, &header.Format, &binary[0]);
+
+#ifdef _WIN32
+  _mkdir(Directory.c_str());
+#else
+  mkdir(Directory.c_str(), 0755);
+#endif
+  std::ofstream file(pathFor(key).c_str(), std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    std::cout << "ERROR::SHADER_CACHE: Failed to write " << pathFor(key) << std::endl;
+    return;
+  }
+  file.write((const char *)&header, sizeof(header));
+  file.write(&binary[0], header.Length);
+}
+
+GLuint ShaderCache::compile(GLenum type, const std::string &code)
+{
+  const char *source = code.c_str();
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    GLchar infoLog[1024];
+    glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+    std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n"
+              << infoLog << std::endl;
+  }
+  return shader;
+}
+
+GLuint ShaderCache::link(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode,
+                         const std::string &tcShaderCode, const std::string &teShaderCode)
+{
+  GLuint vertex = compile(GL_VERTEX_SHADER, vShaderCode);
+  GLuint fragment = compile(GL_FRAGMENT_SHADER, fShaderCode);
+  GLuint geometry = 0, control = 0, evaluation = 0;
+  if (!gShaderCode.empty())
+    geometry = compile(GL_GEOMETRY_SHADER, gShaderCode);
+  if (!tcShaderCode.empty())
+    control = compile(GL_TESS_CONTROL_SHADER, tcShaderCode);
+  if (!teShaderCode.empty())
+    evaluation = compile(GL_TESS_EVALUATION_SHADER, teShaderCode);
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  if (geometry != 0)
+    glAttachShader(program, geometry);
+  if (control != 0)
+    glAttachShader(program, control);
+  if (evaluation != 0)
+    glAttachShader(program, evaluation);
+  if (supported())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(program);
+  program = checkLink(program);
+  // delete the shaders as they're linked into our program now and no longer necessery
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+  if (geometry != 0)
+    glDeleteShader(geometry);
+  if (control != 0)
+    glDeleteShader(control);
+  if (evaluation != 0)
+    glDeleteShader(evaluation);
+  return program;
+}
+
+GLuint ShaderCache::linkCompute(const std::string &cShaderCode)
+{
+  GLuint compute = compile(GL_COMPUTE_SHADER, cShaderCode);
+  GLuint program = glCreateProgram();
+  glAttachShader(program, compute);
+  if (supported())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(program);
+  program = checkLink(program);
+  glDeleteShader(compute);
+  return program;
+}
+
+GLuint ShaderCache::checkLink(GLuint program)
+{
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    GLchar infoLog[1024];
+    glGetProgramInfoLog(program, 1024, NULL, infoLog);
+    std::cout << "ERROR::PROGRAM_LINKING_ERROR\n"
+              << infoLog << std::endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+#include <string>
+
+// ShaderCache links shader programs from source and keeps the driver's
+// program binary on disk, keyed by a hash of the sources together with the
+// GL vendor, renderer and version strings. Later runs load the binary with
+// glProgramBinary and only fall back to compiling when the driver rejects
+// it (driver update, different GPU) or program binaries are unsupported.
+class ShaderCache
+{
+public:
+  // Directory the binaries are written to, created on first store
+  static std::string Directory;
+  // Returns a linked program. gShaderCode may be empty when there is no geometry shader
+  static GLuint LoadProgram(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode);
+  // Returns a linked program with tessellation control and evaluation stages (GL 4.0)
+  static GLuint LoadTessellationProgram(const std::string &vShaderCode, const std::string &tcShaderCode, const std::string &teShaderCode,
+                                        const std::string &fShaderCode);
+  // Returns a linked compute program (GL 4.3)
+  static GLuint LoadComputeProgram(const std::string &cShaderCode);
+  // Number of programs loaded from / compiled and written to the cache since startup
+  static int Hits, Misses;
+
+private:
+  ShaderCache() {}
+  // 64-bit FNV-1a over the driver strings and all shader stages, the
+  // tessellation stages only when present so other keys are unchanged
+  static unsigned long long hash(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode,
+                                 const std::string &tcShaderCode = std::string(), const std::string &teShaderCode = std::string());
+  static std::string pathFor(unsigned long long key);
+  // Whether glGetProgramBinary/glProgramBinary can be used on this context
+  static bool supported();
+  static GLuint loadBinary(unsigned long long key);
+  static void storeBinary(unsigned long long key, GLuint program);
+  static GLuint compile(GLenum type, const std::string &code);
+  static GLuint link(const std::string &vShaderCode, const std::string &fShaderCode, const std::string &gShaderCode,
+                     const std::string &tcShaderCode = std::string(), const std::string &teShaderCode = std::string());
+  static GLuint linkCompute(const std::string &cShaderCode);
+  // Checks the link status, prints the log and deletes the program on failure
+  static GLuint checkLink(GLuint program);
+};
+
+#endif
@@ -0,0 +1,107 @@
+// Shadow lookup shared by the lighting shaders: #include "shadow.glsl"
+// after frame_data.glsl. The cascades are sampled through a depth
+// compare sampler, so every tap returns the bilinear blend of a 2x2
+// depth test. SHADOW_KERNEL picks the filter: 1, 4 or 9 taps on a grid,
+// or 16 taps on a Poisson disk.
+// With SHADOW_EVSM the cascades hold blurred, mipmapped exponential moments
+// instead and a single filtered fetch gives the shadow.
+#ifndef SHADOW_KERNEL
+#define SHADOW_KERNEL 4
+#endif
+
+#include "shadow_data.glsl"
+
+#ifdef SHADOW_EVSM
+uniform sampler2DArray shadowMap;
+#else
+uniform sampler2DArrayShadow shadowMap;
+#endif
+
+// index of the cascade covering a fragment, by its view space depth
+int CascadeIndex(float depth)
+{
+    for (int i = 0; i < CascadeCount - 1; ++i)
+    {
+        if (depth < CascadeSplits[i])
+            return i;
+    }
+    return CascadeCount - 1;
+}
+
+#ifdef SHADOW_EVSM
+// upper bound on the lit fraction (Chebyshev), with the tail cut off by
+// BleedReduction to hide light bleeding where occluders overlap
+float ChebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+    if (depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float p = variance / (variance + d * d);
+    return clamp((p - BleedReduction) / (1.0 - BleedReduction), 0.0, 1.0);
+}
+#elif SHADOW_KERNEL == 16
+const vec2 poissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+#endif
+
+// fraction of the light blocked at fragPos (world space)
+float ShadowCalculation(vec3 fragPos, vec3 normal, vec3 lightDir)
+{
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    // no shadow beyond the shadow distance
+    if (viewDepth > CascadeSplits[CascadeCount - 1])
+        return 0.0;
+    int cascade = CascadeIndex(viewDepth);
+    vec4 fragPosLightSpace = CascadeMatrices[cascade] * vec4(fragPos, 1.0);
+    // perform perspective divide and transform to [0,1] range
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+    if (projCoords.z > 1.0)
+        return 0.0;
+#ifdef SHADOW_EVSM
+    // warp the depth like the light pass did, the moments are pre-filtered
+    float warped = projCoords.z * 2.0 - 1.0;
+    float pos = exp(EvsmExponent * warped);
+    float neg = -exp(-EvsmExponent * warped);
+    vec4 moments = texture(shadowMap, vec3(projCoords.xy, float(cascade)));
+    // allow about one texel of depth variance, scaled by the slope of the warp
+    float texelDepth = CascadeBias[cascade] * 2.0 * EvsmExponent;
+    float litPos = ChebyshevUpperBound(moments.xy, pos, pos * pos * texelDepth * texelDepth);
+    float litNeg = ChebyshevUpperBound(moments.zw, neg, neg * neg * texelDepth * texelDepth);
+    return 1.0 - min(litPos, litNeg);
+#else
+    // calculate bias (based on the texel size of the cascade and slope)
+    float bias = max(6.0 * (1.0 - dot(normal, lightDir)), 1.5) * CascadeBias[cascade];
+    vec4 coord = vec4(projCoords.xy, float(cascade), projCoords.z - bias);
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+
+    float lit = 0.0;
+#if SHADOW_KERNEL == 1
+    lit = texture(shadowMap, coord);
+#elif SHADOW_KERNEL == 4
+    for (int x = 0; x < 2; ++x)
+        for (int y = 0; y < 2; ++y)
+            lit += texture(shadowMap, coord + vec4((vec2(x, y) * 2.0 - 1.0) * texelSize, 0.0, 0.0));
+    lit /= 4.0;
+#elif SHADOW_KERNEL == 9
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadowMap, coord + vec4(vec2(x, y) * texelSize, 0.0, 0.0));
+    lit /= 9.0;
+#else
+    for (int i = 0; i < 16; ++i)
+        lit += texture(shadowMap, coord + vec4(poissonDisk[i] * 2.0 * texelSize, 0.0, 0.0));
+    lit /= 16.0;
+#endif
+    return 1.0 - lit;
+#endif
+}
\ No newline at end of file
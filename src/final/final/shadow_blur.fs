@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2DArray source;
+uniform int layer;
+// one texel step along the blur axis
+uniform vec2 direction;
+
+// 9 tap Gaussian in 5 bilinear fetches
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+    vec4 sum = textureLod(source, vec3(TexCoords, layer), 0.0) * weights[0];
+    for (int i = 1; i < 3; ++i)
+    {
+        sum += textureLod(source, vec3(TexCoords + direction * offsets[i], layer), 0.0) * weights[i];
+        sum += textureLod(source, vec3(TexCoords - direction * offsets[i], layer), 0.0) * weights[i];
+    }
+    FragColor = sum;
+}
\ No newline at end of file
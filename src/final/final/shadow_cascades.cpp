@@ -0,0 +1,293 @@
+#include "shadow_cascades.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+static_assert(sizeof(ShadowData) == 304, "ShadowData must match the std140 layout of the ShadowData block");
+
+ShadowCascades::ShadowCascades(int count, int resolution, ShadowMode mode)
+    : DepthArray(0), FBO(0), UBO(0), Mode(mode), MomentArray(0), BlurArray(0), DepthBuffer(0), Count(count < 1 ? 1 : (count > MAX_CASCADES ? MAX_CASCADES : count)), Resolution(resolution), Lambda(0.6f),
+      AngleThreshold(glm::radians(1.0f)), Margin(0.15f), LightDir(0.0f), Valid(false), BlurFBO(0), VAO(0),
+      BlurLayerLocation(-1), BlurDirectionLocation(-1)
+{
+  this->Data = ShadowData();
+  this->Data.cascadeCount = this->Count;
+  this->Data.bleedReduction = 0.3f;
+  this->Data.evsmExponent = 5.0f;
+  for (int i = 0; i < MAX_CASCADES; i++)
+    this->Dirty[i] = false;
+
+  if (this->Mode == SHADOW_EVSM)
+  {
+    // moment layers with a full mip chain for the receivers' trilinear fetch
+    int levels = 1;
+    while ((resolution >> levels) > 0)
+      levels++;
+    glGenTextures(1, &this->MomentArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->MomentArray);
+    for (int level = 0; level < levels; level++)
+    {
+      int size = resolution >> level;
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA16F, size, size, this->Count, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // scratch layer between the horizontal and the vertical blur
+    glGenTextures(1, &this->BlurArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->BlurArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, resolution, resolution, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenRenderbuffers(1, &this->DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &this->FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->MomentArray, 0, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->DepthBuffer);
+    glGenFramebuffers(1, &this->BlurFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the blur draws a full screen triangle from gl_VertexID
+    glGenVertexArrays(1, &this->VAO);
+  }
+  else
+  {
+    glGenTextures(1, &this->DepthArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->DepthArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, this->Count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // Sampled through sampler2DArrayShadow: every fetch is a bilinear 2x2 depth test
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float borderColor[] = {1.0, 1.0, 1.0, 1.0};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &this->FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->DepthArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  glGenBuffers(1, &this->UBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowData), &this->Data, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_DATA_BINDING, this->UBO);
+}
+
+void ShadowCascades::Update(const glm::mat4 &view, float fovy, float aspect, float nearPlane, float shadowDistance, const glm::vec3 &lightDir, const AABB &casters)
+{
+  // Split distances, blending a logarithmic and a uniform distribution
+  for (int i = 0; i < MAX_CASCADES; i++)
+  {
+    float p = (float)(i + 1) / this->Count;
+    float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, p);
+    float uniformSplit = nearPlane + (shadowDistance - nearPlane) * p;
+    this->Data.cascadeSplits[i] = i < this->Count ? this->Lambda * logSplit + (1.0f - this->Lambda) * uniformSplit : shadowDistance;
+  }
+
+  // The layers keep the direction they were drawn for until the light
+  // turned past the threshold, then every cascade is refitted
+  glm::vec3 dir = glm::normalize(lightDir);
+  if (!this->Valid || glm::dot(dir, this->LightDir) < std::cos(this->AngleThreshold))
+  {
+    this->LightDir = dir;
+    this->Valid = false;
+  }
+
+  // The light looks from the origin along -LightDir. Its up vector is the
+  // world axis least aligned with the light, so it rarely switches.
+  glm::vec3 up(0.0f);
+  glm::vec3 absDir = glm::abs(this->LightDir);
+  up[(absDir.x < absDir.y && absDir.x < absDir.z) ? 0 : (absDir.y < absDir.z ? 1 : 2)] = 1.0f;
+  glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -this->LightDir, up);
+
+  // Highest point of the casters towards the light, the near plane is pulled back to it
+  float casterTop = -1e30f;
+  if (!casters.Empty())
+    for (int c = 0; c < 8; c++)
+    {
+      glm::vec3 corner((c & 1) ? casters.Max.x : casters.Min.x, (c & 2) ? casters.Max.y : casters.Min.y, (c & 4) ? casters.Max.z : casters.Min.z);
+      casterTop = std::max(casterTop, (lightView * glm::vec4(corner, 1.0f)).z);
+    }
+
+  glm::mat4 invView = glm::inverse(view);
+  float tanHalf = std::tan(fovy * 0.5f);
+  float splitNear = nearPlane;
+  for (int i = 0; i < this->Count; i++)
+  {
+    float splitFar = this->Data.cascadeSplits[i];
+    // Corners of the slice in world space
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for (int c = 0; c < 8; c++)
+    {
+      float z = (c & 4) ? splitFar : splitNear;
+      glm::vec4 corner((c & 1 ? 1.0f : -1.0f) * z * tanHalf * aspect, (c & 2 ? 1.0f : -1.0f) * z * tanHalf, -z, 1.0f);
+      corners[c] = glm::vec3(invView * corner);
+      center += corners[c];
+    }
+    center /= 8.0f;
+    // A bounding sphere keeps the projection size constant while the camera turns
+    float radius = 0.0f;
+    for (int c = 0; c < 8; c++)
+      radius = std::max(radius, glm::length(corners[c] - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+    glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+    splitNear = splitFar;
+
+    // Keep the cached layer while the slice is still inside the region it covers
+    float fitHalf = 0.5f * (this->FitMax[i].x - this->FitMin[i].x);
+    if (this->Valid && fitHalf <= radius * (1.0f + 2.0f * this->Margin) &&
+        lightCenter.x - radius >= this->FitMin[i].x && lightCenter.x + radius <= this->FitMax[i].x &&
+        lightCenter.y - radius >= this->FitMin[i].y && lightCenter.y + radius <= this->FitMax[i].y &&
+        lightCenter.z - radius >= this->FitMin[i].z && lightCenter.z + radius <= this->FitMax[i].z)
+      continue;
+
+    // Refit with a margin, moving the center in whole texels so the rasterized shadow edges stay put
+    float half = radius * (1.0f + this->Margin);
+    float texel = 2.0f * half / this->Resolution;
+    lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+    lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+
+    float top = lightCenter.z + half;
+    if (casterTop > top)
+      top = casterTop;
+    this->FitMin[i] = glm::vec3(lightCenter.x - half, lightCenter.y - half, lightCenter.z - half);
+    this->FitMax[i] = glm::vec3(lightCenter.x + half, lightCenter.y + half, top);
+    glm::mat4 lightProjection = glm::ortho(this->FitMin[i].x, this->FitMax[i].x, this->FitMin[i].y, this->FitMax[i].y, -this->FitMax[i].z, -this->FitMin[i].z);
+    this->Data.cascadeMatrices[i] = lightProjection * lightView;
+    // depth range in [0,1] covered by one texel of world space distance
+    this->Data.cascadeBias[i] = texel / (this->FitMax[i].z - this->FitMin[i].z);
+    this->Dirty[i] = true;
+  }
+  this->Valid = true;
+
+  bool changed = false;
+  for (int i = 0; i < this->Count; i++)
+    changed = changed || this->Dirty[i];
+  if (!changed)
+    return;
+  glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowData), &this->Data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ShadowCascades::Invalidate(const AABB &bounds)
+{
+  for (int i = 0; i < this->Count; i++)
+    if (Frustum(this->Data.cascadeMatrices[i]).Test(bounds) != Frustum::OUTSIDE)
+      this->Dirty[i] = true;
+}
+
+void ShadowCascades::Invalidate()
+{
+  for (int i = 0; i < this->Count; i++)
+    this->Dirty[i] = true;
+}
+
+void ShadowCascades::Begin(int cascade)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+  glViewport(0, 0, this->Resolution, this->Resolution);
+  if (this->Mode == SHADOW_EVSM)
+  {
+    // the moments are written as they are, their w is not an opacity; End enables blending again
+    glDisable(GL_BLEND);
+    // clear to the moments of the far plane
+    float c = this->Data.evsmExponent;
+    float far[4] = {std::exp(c), std::exp(2.0f * c), -std::exp(-c), std::exp(-2.0f * c)};
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->MomentArray, 0, cascade);
+    glClearBufferfv(GL_COLOR, 0, far);
+  }
+  else
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->DepthArray, 0, cascade);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowCascades::End(int width, int height)
+{
+  bool redrawn = false;
+  if (this->Mode == SHADOW_EVSM)
+  {
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    for (int i = 0; i < this->Count; i++)
+    {
+      if (!this->Dirty[i])
+        continue;
+      this->blur(this->MomentArray, i, this->BlurArray, 0, 1.0f, 0.0f);
+      this->blur(this->BlurArray, 0, this->MomentArray, i, 0.0f, 1.0f);
+      redrawn = true;
+    }
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    if (redrawn)
+    {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, this->MomentArray);
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+  }
+  for (int i = 0; i < MAX_CASCADES; i++)
+    this->Dirty[i] = false;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+}
+
+void ShadowCascades::SetBlurShader(Shader shader)
+{
+  this->BlurShader = shader;
+  this->BlurShader.use();
+  // the source layer is always read from unit 0
+  glUniform1i(glGetUniformLocation(shader.ID, "source"), 0);
+  this->BlurLayerLocation = glGetUniformLocation(shader.ID, "layer");
+  this->BlurDirectionLocation = glGetUniformLocation(shader.ID, "direction");
+}
+
+void ShadowCascades::blur(GLuint source, int sourceLayer, GLuint target, int targetLayer, float dx, float dy)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, this->BlurFBO);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, 0, targetLayer);
+  this->BlurShader.use();
+  glUniform1i(this->BlurLayerLocation, sourceLayer);
+  glUniform2f(this->BlurDirectionLocation, dx / this->Resolution, dy / this->Resolution);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, source);
+  glBindVertexArray(this->VAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+}
+
+void ShadowCascades::Bind(GLenum unit) const
+{
+  glActiveTexture(unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->Mode == SHADOW_EVSM ? this->MomentArray : this->DepthArray);
+}
+
+void ShadowCascades::Release()
+{
+  glDeleteFramebuffers(1, &this->FBO);
+  glDeleteFramebuffers(1, &this->BlurFBO);
+  glDeleteTextures(1, &this->DepthArray);
+  glDeleteTextures(1, &this->MomentArray);
+  glDeleteTextures(1, &this->BlurArray);
+  glDeleteRenderbuffers(1, &this->DepthBuffer);
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteBuffers(1, &this->UBO);
+  this->FBO = this->BlurFBO = this->DepthArray = this->MomentArray = this->BlurArray = this->DepthBuffer = this->VAO = this->UBO = 0;
+}
@@ -0,0 +1,96 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frame_uniforms.h"
+#include "culling.h"
+#include <learnopengl/shader.h>
+
+const int MAX_CASCADES = 4;
+
+// CPU mirror of the std140 "ShadowData" block
+struct ShadowData
+{
+  glm::mat4 cascadeMatrices[MAX_CASCADES]; // light projection * view of each cascade
+  glm::vec4 cascadeSplits;                 // view space distance where each cascade ends
+  glm::vec4 cascadeBias;                   // depth of one shadow map texel in each cascade
+  int cascadeCount;
+  float bleedReduction; // EVSM: fraction of the Chebyshev bound cut off against light bleeding
+  float evsmExponent;   // EVSM: warp exponent, at most ~5.5 for 16 bit float moments
+  int padding;
+};
+
+// How the cascades are stored and filtered
+enum ShadowMode
+{
+  SHADOW_PCF, // depth layers sampled with hardware depth compare
+  SHADOW_EVSM // exponential variance moments, blurred and mipmapped
+};
+
+// Cascaded shadow maps for the directional sun light. The camera frustum up
+// to a shadow distance is cut into 2-4 slices; each slice gets its own
+// orthographic light projection and a layer of a depth texture array.
+// Projections are fitted to the bounding sphere of the slice and snapped to
+// whole texels, so shadows do not shimmer when the camera moves or turns.
+//
+// In SHADOW_EVSM mode the light pass writes four exponential moments into
+// an RGBA16F array instead. Every redrawn layer is blurred with a separable
+// Gaussian and the array is mipmapped, so receivers need one filtered fetch
+// and the layers can be much smaller than depth maps of the same quality.
+//
+// The scene is static, so the layers are cached: a cascade is only marked
+// Dirty (to be redrawn) when the light turned by more than AngleThreshold,
+// when its slice left the padded region the layer was last fitted to, or
+// when Invalidate reports a moving caster inside it.
+class ShadowCascades
+{
+public:
+  GLuint DepthArray, FBO, UBO;
+  ShadowMode Mode;
+  GLuint MomentArray, BlurArray, DepthBuffer; // SHADOW_EVSM only
+  int Count;            // number of cascades
+  int Resolution;       // width and height of every layer
+  float Lambda;         // split scheme, 0 uniform .. 1 logarithmic
+  float AngleThreshold; // radians the light may turn before the layers are redrawn
+  float Margin;         // extra coverage of a fit, relative to the slice radius
+  bool Dirty[MAX_CASCADES];
+  ShadowData Data;
+
+  // Creates the layer texture array, its framebuffer and the ShadowData buffer
+  ShadowCascades(int count, int resolution, ShadowMode mode = SHADOW_PCF);
+  // Sets the shadow_blur shader, required in SHADOW_EVSM mode
+  void SetBlurShader(Shader shader);
+  // Refits the cascades whose slice of the camera frustum left the cached
+  // region, marks them Dirty and uploads ShadowData if anything changed.
+  // Casters are the bounds of everything that may throw a shadow into the view.
+  void Update(const glm::mat4 &view, float fovy, float aspect, float nearPlane, float shadowDistance, const glm::vec3 &lightDir, const AABB &casters);
+  // Marks the cascades overlapping a moving caster's old or new bounds
+  void Invalidate(const AABB &bounds);
+  // Marks every cascade, e.g. after the casters changed wholesale
+  void Invalidate();
+  // Binds the framebuffer to one cascade's layer, sets the viewport and clears it.
+  // EVSM turns blending off, the moments must not be blended into the target
+  void Begin(int cascade);
+  // Blurs and mipmaps the redrawn layers (EVSM, then enables blending again),
+  // restores the default framebuffer and viewport and clears the Dirty flags
+  void End(int width, int height);
+  // Binds the depth or moment array to a texture unit for the lighting shaders
+  void Bind(GLenum unit) const;
+  // Deletes the GL objects
+  void Release();
+
+private:
+  glm::vec3 LightDir;                  // direction the layers were drawn for
+  glm::vec3 FitMin[MAX_CASCADES];      // light space box each layer covers
+  glm::vec3 FitMax[MAX_CASCADES];
+  bool Valid;
+  GLuint BlurFBO, VAO;
+  Shader BlurShader;
+  GLint BlurLayerLocation, BlurDirectionLocation;
+  // One Gaussian pass from a layer of source into a layer of target
+  void blur(GLuint source, int sourceLayer, GLuint target, int targetLayer, float dx, float dy);
+};
+
+#endif
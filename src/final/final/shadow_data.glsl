@@ -0,0 +1,13 @@
+// cascaded shadow map data, filled once per frame by ShadowCascades
+#ifndef SHADOW_DATA_GLSL
+#define SHADOW_DATA_GLSL
+layout (std140) uniform ShadowData
+{
+    mat4 CascadeMatrices[4];
+    vec4 CascadeSplits;
+    vec4 CascadeBias;
+    int CascadeCount;
+    float BleedReduction; // EVSM only
+    float EvsmExponent;   // EVSM only
+};
+#endif
\ No newline at end of file
@@ -1,6 +1,21 @@
 #version 330 core
 
+#ifdef SHADOW_EVSM
+#include "shadow_data.glsl"
+
+layout (location = 0) out vec4 Moments;
+
+void main()
+{
+    // exponential warp of the depth in [-1, 1], positive and negative
+    float depth = gl_FragCoord.z * 2.0 - 1.0;
+    float pos = exp(EvsmExponent * depth);
+    float neg = -exp(-EvsmExponent * depth);
+    Moments = vec4(pos, pos * pos, neg, neg * neg);
+}
+#else
 void main()
 {             
     // gl_FragDepth = gl_FragCoord.z;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -1,10 +1,12 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
+#include "frame_data.glsl"
+#include "shadow_data.glsl"
 uniform mat4 model;
+uniform int cascade;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = CascadeMatrices[cascade] * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -5,15 +5,15 @@ in vec3 TexCoords;
 
 uniform samplerCube skybox1;
 uniform samplerCube skybox2;
-uniform float time;
+#include "frame_data.glsl"
 
 void main()
 {	
 	float alpha;
-	if (time < 0) {
+	if (DayCycle < 0) {
 		alpha = 0;
 	} else {
-		alpha = time;
+		alpha = DayCycle;
 	}
     FragColor = mix(texture(skybox1, TexCoords), texture(skybox2, TexCoords), 1 - alpha);
 }
\ No newline at end of file
@@ -26,20 +26,18 @@ public:
 	void Draw(Shader *shader) {
     glDepthFunc(GL_LEQUAL);
 		shader->use();
-		shader->setInt("skybox1", 0);
-		shader->setInt("skybox2", 1);
 		glm::mat4 model(1.0f);
 		model = glm::translate(model, this->Position);
 		model = glm::scale(model, this->Size);
-		shader->setMat4("model", model);
+		glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
 
-		auto texture = ResourceManager::GetTexture(this->name);
-		auto night = ResourceManager::GetTexture(this->name2);
+		auto texture = this->day.Get();
+		auto nightTexture = this->night.Get();
 		glBindVertexArray(this->VAO);
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, texture.ID);
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, night.ID);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, nightTexture.ID);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 		glBindVertexArray(0);
 		glDepthFunc(GL_LESS);
@@ -98,15 +96,11 @@ public:
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
 
-    // load cubeTextures to Resources
-    auto cubemapTexture = this->loadCubemap(this->faces);
-    auto cubemapTexture2 = this->loadCubemap(this->faces2);
-	Texture2D t;
-	t.ID = cubemapTexture;
-    ResourceManager::Textures[this->name] = t;
-	Texture2D t2;
-	t2.ID = cubemapTexture2;
-    ResourceManager::Textures[this->name2] = t2;
+    // load cubeTextures to Resources, the skybox is drawn every frame so keep both pinned
+    ResourceManager::LoadCubemap(this->faces, this->name);
+    ResourceManager::LoadCubemap(this->faces2, this->name2);
+    this->day = TextureHandle(this->name);
+    this->night = TextureHandle(this->name2);
   }
 
   private:
@@ -114,7 +108,7 @@ public:
     std::string name;
 	std::vector<std::string> faces2;
 	std::string name2;
-    unsigned int loadCubemap(std::vector<std::string> faces);
+	TextureHandle day, night;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+// Splat lookup of plane.fs with TERRAIN_SPLAT: #include "splat.glsl". The
+// blended layers are baked into the pages of a virtual texture by
+// SplatTexture. The page table, one mip level per page level, points each
+// page at its slot in the atlas or, until it is baked, at its nearest
+// resident ancestor, so a pixel costs one indirection and one fetch.
+
+const float SPLAT_PAGE = 128.0;  // virtual texels per page side
+const float SPLAT_BORDER = 4.0;  // texels around each page in the atlas
+
+uniform sampler2D splatPages;    // atlas slot (x, y) and held level per page, times 1/255
+uniform sampler2D splatAtlas;
+uniform vec3 splatLayout;        // pages per side at level 0, levels, atlas texels per side
+
+vec3 SplatColor(vec2 uv)
+{
+    // the finest level with at most one virtual texel per pixel
+    vec2 texel = uv * splatLayout.x * SPLAT_PAGE;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float level = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0, splatLayout.y - 1.0);
+    uv = clamp(uv, 0.0, 0.99999);
+    ivec2 page = ivec2(uv * (splatLayout.x / exp2(level)));
+    vec3 entry = floor(texelFetch(splatPages, page, int(level)).xyz * 255.0 + 0.5);
+    // position inside the page held, which covers this one
+    vec2 inPage = fract(uv * (splatLayout.x / exp2(entry.z)));
+    vec2 atlas = entry.xy * (SPLAT_PAGE + 2.0 * SPLAT_BORDER) + SPLAT_BORDER + inPage * SPLAT_PAGE;
+    return textureLod(splatAtlas, atlas / splatLayout.z, 0.0).rgb;
+}
@@ -0,0 +1,429 @@
+#include "splat_texture.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <stb_image.h>
+
+#include "culling.h"
+#include "util.h"
+
+namespace
+{
+  // plane.fs blends the two layers below this height, in heightmap units
+  const float SPLAT_BLEND_HEIGHT = 20.0f;
+  // the colour plane.fs paints where the mask is set
+  const glm::vec3 SPLAT_MASK_COLOR(0.5f, 0.6f, 0.0f);
+  // pages per side up to which a level is baked up front and pinned
+  const int SPLAT_PINNED_PAGES = 4;
+  const size_t PAGE_BYTES = (size_t)SPLAT_PAGE_STORED * SPLAT_PAGE_STORED * 4;
+
+  bool loadImage(const char *file, int channels, SplatImage &image)
+  {
+    int width, height;
+    unsigned char *texels = stbi_load(file, &width, &height, 0, channels);
+    if (!texels)
+    {
+      std::cout << "ERROR::SPLAT_TEXTURE: Failed to load " << file << std::endl;
+      return false;
+    }
+    image.Width = width;
+    image.Height = height;
+    image.Channels = channels;
+    image.Texels.assign(texels, texels + (size_t)width * height * channels);
+    stbi_image_free(texels);
+    return true;
+  }
+
+  // The image and its 2x2 box filtered mips down to one texel
+  std::vector<SplatImage> mipChain(const SplatImage &image)
+  {
+    std::vector<SplatImage> chain(1, image);
+    while (chain.back().Width > 1 || chain.back().Height > 1)
+    {
+      const SplatImage &above = chain.back();
+      SplatImage mip;
+      mip.Width = std::max(above.Width / 2, 1);
+      mip.Height = std::max(above.Height / 2, 1);
+      mip.Channels = above.Channels;
+      mip.Texels.resize((size_t)mip.Width * mip.Height * mip.Channels);
+      for (int y = 0; y < mip.Height; y++)
+        for (int x = 0; x < mip.Width; x++)
+          for (int c = 0; c < mip.Channels; c++)
+          {
+            int x0 = std::min(2 * x, above.Width - 1), x1 = std::min(2 * x + 1, above.Width - 1);
+            int y0 = std::min(2 * y, above.Height - 1), y1 = std::min(2 * y + 1, above.Height - 1);
+            int sum = above.Texels[((size_t)y0 * above.Width + x0) * above.Channels + c] +
+                      above.Texels[((size_t)y0 * above.Width + x1) * above.Channels + c] +
+                      above.Texels[((size_t)y1 * above.Width + x0) * above.Channels + c] +
+                      above.Texels[((size_t)y1 * above.Width + x1) * above.Channels + c];
+            mip.Texels[((size_t)y * mip.Width + x) * mip.Channels + c] = (unsigned char)((sum + 2) / 4);
+          }
+      chain.push_back(mip);
+    }
+    return chain;
+  }
+
+  // The mip whose texels are closest in size to a virtual texel of a level
+  const SplatImage &mipFor(const std::vector<SplatImage> &chain, int virtualTexels)
+  {
+    float footprint = (float)chain[0].Width / virtualTexels;
+    int mip = footprint > 1.0f ? (int)std::floor(std::log2(footprint) + 0.5f) : 0;
+    return chain[std::min(mip, (int)chain.size() - 1)];
+  }
+
+  // Bilinear sample at a texture coordinate in [0, 1], repeated like the GL_REPEAT layers
+  glm::vec3 sampleRepeat(const SplatImage &image, float u, float v)
+  {
+    float x = u * image.Width - 0.5f, y = v * image.Height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float ax = x - fx, ay = y - fy;
+    int x0 = (((int)fx % image.Width) + image.Width) % image.Width, x1 = (x0 + 1) % image.Width;
+    int y0 = (((int)fy % image.Height) + image.Height) % image.Height, y1 = (y0 + 1) % image.Height;
+    glm::vec3 result(0.0f);
+    for (int c = 0; c < std::min(image.Channels, 3); c++)
+    {
+      float t00 = image.Texels[((size_t)y0 * image.Width + x0) * image.Channels + c];
+      float t10 = image.Texels[((size_t)y0 * image.Width + x1) * image.Channels + c];
+      float t01 = image.Texels[((size_t)y1 * image.Width + x0) * image.Channels + c];
+      float t11 = image.Texels[((size_t)y1 * image.Width + x1) * image.Channels + c];
+      result[c] = ((t00 * (1.0f - ax) + t10 * ax) * (1.0f - ay) + (t01 * (1.0f - ax) + t11 * ax) * ay) / 255.0f;
+    }
+    return result;
+  }
+
+  // Height between the heightmap texels, texel k at texture coordinate k / width like Plane
+  float heightAt(const SplatImage &heights, float u, float v)
+  {
+    float x = std::min(std::max(u * heights.Width, 0.0f), heights.Width - 1.0f);
+    float y = std::min(std::max(v * heights.Height, 0.0f), heights.Height - 1.0f);
+    int x0 = std::min((int)x, heights.Width - 2), y0 = std::min((int)y, heights.Height - 2);
+    float ax = x - x0, ay = y - y0;
+    const unsigned char *row0 = &heights.Texels[(size_t)y0 * heights.Width], *row1 = row0 + heights.Width;
+    return (row0[x0] * (1.0f - ax) + row0[x0 + 1] * ax) * (1.0f - ay) + (row1[x0] * (1.0f - ax) + row1[x0 + 1] * ax) * ay;
+  }
+}
+
+SplatTexture::SplatTexture(const char *texture1, const char *texture2, const char *mask, const char *heightmap, glm::vec3 position,
+                           glm::vec3 scale, int size, int atlasPages, int pagesPerFrame)
+  : PageTable(0), Atlas(0), Size(SPLAT_PAGE), Levels(1), AtlasPages(0), PagesPerFrame(pagesPerFrame), Position(position),
+    Scale(scale), Frame(1), Quit(false)
+{
+  SplatImage layer1, layer2, maskImage;
+  if (!loadImage(texture1, STBI_rgb, layer1) || !loadImage(texture2, STBI_rgb, layer2) || !loadImage(mask, STBI_rgb, maskImage) ||
+      !loadImage(heightmap, STBI_grey, this->Heights))
+    return;
+  if (this->Heights.Width < 2 || this->Heights.Height < 2)
+  {
+    std::cout << "ERROR::SPLAT_TEXTURE: A heightmap needs at least 2x2 texels" << std::endl;
+    return;
+  }
+  this->Layer1 = mipChain(layer1);
+  this->Layer2 = mipChain(layer2);
+  this->Mask = mipChain(maskImage);
+
+  while (this->Size < size && this->Levels < SPLAT_MAX_LEVELS)
+  {
+    this->Size *= 2;
+    this->Levels++;
+  }
+  // slot coordinates are stored in 8 bits, the pinned levels must fit with room to stream
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  this->AtlasPages = std::min(std::min(atlasPages, 255), maxSize / SPLAT_PAGE_STORED);
+  int pinnedLevels = std::min(this->Levels, 1 + (int)std::log2((float)SPLAT_PINNED_PAGES));
+  int pinned = 0;
+  for (int level = this->Levels - pinnedLevels; level < this->Levels; level++)
+    pinned += this->pagesAt(level) * this->pagesAt(level);
+  if (this->AtlasPages * this->AtlasPages < pinned + 16)
+  {
+    std::cout << "ERROR::SPLAT_TEXTURE: The atlas is too small for the pinned pages" << std::endl;
+    return;
+  }
+
+  glGenTextures(1, &this->Atlas);
+  glBindTexture(GL_TEXTURE_2D, this->Atlas);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, this->AtlasPages * SPLAT_PAGE_STORED, this->AtlasPages * SPLAT_PAGE_STORED, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // one mip level per page level, each texel an (x, y) slot and the level it holds
+  glGenTextures(1, &this->PageTable);
+  glBindTexture(GL_TEXTURE_2D, this->PageTable);
+  for (int level = 0; level < this->Levels; level++)
+  {
+    this->Entries[level].assign((size_t)this->pagesAt(level) * this->pagesAt(level) * 4, 0);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, this->pagesAt(level), this->pagesAt(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, this->Levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  Slot empty = {-1, 0, false};
+  this->SlotTable.assign(this->AtlasPages * this->AtlasPages, empty);
+  std::vector<long long> keys;
+  for (int level = this->Levels - pinnedLevels; level < this->Levels; level++)
+    for (int y = 0; y < this->pagesAt(level); y++)
+      for (int x = 0; x < this->pagesAt(level); x++)
+        keys.push_back(key(level, x, y));
+  // once at load, over all cores
+  std::vector<unsigned char> texels(PAGE_BYTES * keys.size());
+  parallel_for((int)keys.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      this->bake(keys[i], &texels[PAGE_BYTES * i]);
+  });
+  glBindTexture(GL_TEXTURE_2D, this->Atlas);
+  for (size_t i = 0; i < keys.size(); i++)
+    this->upload(keys[i], &texels[PAGE_BYTES * i], true);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  this->updatePageTable();
+
+  this->Baker = std::thread(&SplatTexture::run, this);
+}
+
+SplatTexture::~SplatTexture()
+{
+  this->Release();
+}
+
+void SplatTexture::Update(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &viewPos, float viewportHeight)
+{
+  if (!this->Valid())
+    return;
+  Frustum frustum(projection * view);
+  // pixels per world unit at distance 1
+  float pixelScale = 0.5f * viewportHeight * projection[1][1];
+  glm::vec2 extent(this->Heights.Width * this->Scale.x, this->Heights.Height * this->Scale.z);
+  float top = this->Position.y + 255.0f * this->Scale.y;
+
+  // breadth first from the root, so coarser pages are baked first
+  std::vector<long long> needed(1, key(this->Levels - 1, 0, 0));
+  std::vector<long long> misses;
+  for (size_t i = 0; i < needed.size(); i++)
+  {
+    int level = (int)(needed[i] >> 48), y = (int)((needed[i] >> 24) & 0xffffff), x = (int)(needed[i] & 0xffffff);
+    std::unordered_map<long long, int>::iterator found = this->Lookup.find(needed[i]);
+    if (found != this->Lookup.end())
+      this->SlotTable[found->second].LastUsed = this->Frame;
+    else
+      misses.push_back(needed[i]);
+    if (level == 0)
+      continue;
+
+    // refine while a texel of this level covers more than a pixel somewhere on the page
+    float pages = (float)this->pagesAt(level);
+    AABB box(glm::vec3(this->Position.x + x / pages * extent.x, this->Position.y, this->Position.z + y / pages * extent.y),
+             glm::vec3(this->Position.x + (x + 1) / pages * extent.x, top, this->Position.z + (y + 1) / pages * extent.y));
+    float texel = std::max(extent.x, extent.y) / (this->Size >> level);
+    if (texel * pixelScale <= std::max(box.Distance(viewPos), 1e-3f))
+      continue;
+    for (int j = 0; j < 2; j++)
+      for (int k = 0; k < 2; k++)
+      {
+        float children = (float)this->pagesAt(level - 1);
+        AABB child(glm::vec3(this->Position.x + (2 * x + k) / children * extent.x, this->Position.y,
+                             this->Position.z + (2 * y + j) / children * extent.y),
+                   glm::vec3(this->Position.x + (2 * x + k + 1) / children * extent.x, top,
+                             this->Position.z + (2 * y + j + 1) / children * extent.y));
+        if (frustum.Test(child) != Frustum::OUTSIDE)
+          needed.push_back(key(level - 1, 2 * x + k, 2 * y + j));
+      }
+  }
+
+  std::vector<std::pair<long long, std::vector<unsigned char> > > baked;
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    baked.swap(this->Baked);
+  }
+  if (!baked.empty())
+  {
+    glBindTexture(GL_TEXTURE_2D, this->Atlas);
+    // a page that finds no slot is asked for again when still needed
+    for (size_t i = 0; i < baked.size(); i++)
+      if (!this->Lookup.count(baked[i].first))
+        this->upload(baked[i].first, &baked[i].second[0], false);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->updatePageTable();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    for (size_t i = 0; i < baked.size(); i++)
+      this->InFlight.erase(baked[i].first);
+    // pages still queued but no longer wanted are dropped, this frame's misses replace them
+    for (size_t i = 0; i < this->Queue.size(); i++)
+      this->InFlight.erase(this->Queue[i]);
+    this->Queue.clear();
+    for (size_t i = 0; i < misses.size(); i++)
+      if (!this->Lookup.count(misses[i]) && this->InFlight.insert(misses[i]).second)
+        this->Queue.push_back(misses[i]);
+  }
+  this->Wake.notify_one();
+  this->Frame++;
+}
+
+void SplatTexture::SetUniforms(Shader *shader, int pageUnit, int atlasUnit) const
+{
+  glUniform1i(glGetUniformLocation(shader->ID, "splatPages"), pageUnit);
+  glUniform1i(glGetUniformLocation(shader->ID, "splatAtlas"), atlasUnit);
+  glUniform3f(glGetUniformLocation(shader->ID, "splatLayout"), (float)(this->Size / SPLAT_PAGE), (float)this->Levels,
+              (float)(this->AtlasPages * SPLAT_PAGE_STORED));
+}
+
+void SplatTexture::Bind(int pageUnit, int atlasUnit) const
+{
+  glActiveTexture(GL_TEXTURE0 + pageUnit);
+  glBindTexture(GL_TEXTURE_2D, this->PageTable);
+  glActiveTexture(GL_TEXTURE0 + atlasUnit);
+  glBindTexture(GL_TEXTURE_2D, this->Atlas);
+}
+
+void SplatTexture::Release()
+{
+  if (this->Baker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Quit = true;
+    }
+    this->Wake.notify_one();
+    this->Baker.join();
+  }
+  this->Queue.clear();
+  this->Baked.clear();
+  this->InFlight.clear();
+  glDeleteTextures(1, &this->PageTable);
+  glDeleteTextures(1, &this->Atlas);
+  this->PageTable = this->Atlas = 0;
+  this->Lookup.clear();
+  this->SlotTable.clear();
+  this->Layer1.clear();
+  this->Layer2.clear();
+  this->Mask.clear();
+  this->Heights.Texels.clear();
+}
+
+long long SplatTexture::key(int level, int x, int y)
+{
+  return ((long long)level << 48) | ((long long)y << 24) | (long long)x;
+}
+
+// A free slot or the least recently used one not needed this frame, -1 when
+// every slot is pinned or in use
+int SplatTexture::acquireSlot(long long key, bool pinned)
+{
+  int victim = -1;
+  for (int i = 0; i < (int)this->SlotTable.size(); i++)
+  {
+    const Slot &slot = this->SlotTable[i];
+    if (slot.Key < 0)
+    {
+      victim = i;
+      break;
+    }
+    if (!slot.Pinned && slot.LastUsed < this->Frame && (victim < 0 || slot.LastUsed < this->SlotTable[victim].LastUsed))
+      victim = i;
+  }
+  if (victim < 0)
+    return -1;
+  Slot &slot = this->SlotTable[victim];
+  if (slot.Key >= 0)
+    this->Lookup.erase(slot.Key);
+  slot.Key = key;
+  slot.LastUsed = this->Frame;
+  slot.Pinned = pinned;
+  this->Lookup[key] = victim;
+  return victim;
+}
+
+// The splat of plane.fs at every texel of a page and its border, RGBA
+void SplatTexture::bake(long long key, unsigned char *texels) const
+{
+  int level = (int)(key >> 48), y = (int)((key >> 24) & 0xffffff), x = (int)(key & 0xffffff);
+  int levelSize = this->Size >> level;
+  const SplatImage &layer1 = mipFor(this->Layer1, levelSize), &layer2 = mipFor(this->Layer2, levelSize);
+  const SplatImage &mask = mipFor(this->Mask, levelSize);
+  for (int j = 0; j < SPLAT_PAGE_STORED; j++)
+    for (int i = 0; i < SPLAT_PAGE_STORED; i++)
+    {
+      float u = (x * SPLAT_PAGE + i - SPLAT_BORDER + 0.5f) / levelSize;
+      float v = (y * SPLAT_PAGE + j - SPLAT_BORDER + 0.5f) / levelSize;
+      float height = heightAt(this->Heights, u, v);
+      glm::vec3 color = sampleRepeat(layer1, u, v);
+      if (height <= SPLAT_BLEND_HEIGHT)
+        color = glm::mix(color, sampleRepeat(layer2, u, v), 1.0f - height / SPLAT_BLEND_HEIGHT);
+      float alpha = sampleRepeat(mask, u, v).x;
+      color = color * (1.0f - alpha) + SPLAT_MASK_COLOR * alpha;
+      unsigned char *texel = texels + ((size_t)j * SPLAT_PAGE_STORED + i) * 4;
+      for (int c = 0; c < 3; c++)
+        texel[c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+      texel[3] = 255;
+    }
+}
+
+// Puts a baked page into a slot, with the atlas bound
+bool SplatTexture::upload(long long key, const unsigned char *texels, bool pinned)
+{
+  int slot = this->acquireSlot(key, pinned);
+  if (slot < 0)
+    return false;
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % this->AtlasPages) * SPLAT_PAGE_STORED, (slot / this->AtlasPages) * SPLAT_PAGE_STORED,
+                  SPLAT_PAGE_STORED, SPLAT_PAGE_STORED, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+  return true;
+}
+
+// Points every page at its slot, or at the entry of its parent when it is
+// not resident, coarsest level first
+void SplatTexture::updatePageTable()
+{
+  glBindTexture(GL_TEXTURE_2D, this->PageTable);
+  for (int level = this->Levels - 1; level >= 0; level--)
+  {
+    int pages = this->pagesAt(level);
+    std::vector<unsigned char> &entries = this->Entries[level];
+    for (int y = 0; y < pages; y++)
+      for (int x = 0; x < pages; x++)
+      {
+        unsigned char *entry = &entries[((size_t)y * pages + x) * 4];
+        std::unordered_map<long long, int>::const_iterator found = this->Lookup.find(key(level, x, y));
+        if (found != this->Lookup.end())
+        {
+          entry[0] = (unsigned char)(found->second % this->AtlasPages);
+          entry[1] = (unsigned char)(found->second / this->AtlasPages);
+          entry[2] = (unsigned char)level;
+          entry[3] = 255;
+        }
+        else if (level + 1 < this->Levels)
+        {
+          const unsigned char *parent = &this->Entries[level + 1][((size_t)(y / 2) * (pages / 2) + x / 2) * 4];
+          std::copy(parent, parent + 4, entry);
+        }
+      }
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, &entries[0]);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void SplatTexture::run()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  while (true)
+  {
+    this->Wake.wait(lock, [this] { return this->Quit || (!this->Queue.empty() && (int)this->Baked.size() < this->PagesPerFrame); });
+    if (this->Quit)
+      return;
+    long long k = this->Queue.front();
+    this->Queue.pop_front();
+    lock.unlock();
+    // the source images are immutable while the baker runs
+    std::vector<unsigned char> texels(PAGE_BYTES);
+    this->bake(k, &texels[0]);
+    lock.lock();
+    this->Baked.push_back(std::make_pair(k, std::move(texels)));
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef SPLAT_TEXTURE_H
+#define SPLAT_TEXTURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <learnopengl/shader.h>
+
+// Virtual texels per page side
+const int SPLAT_PAGE = 128;
+// Texels copied from the neighbouring pages around each page in the atlas,
+// so bilinear filtering never reads another page
+const int SPLAT_BORDER = 4;
+const int SPLAT_PAGE_STORED = SPLAT_PAGE + 2 * SPLAT_BORDER;
+// Levels of the virtual texture at most, a 2^22 texel wide virtual texture
+const int SPLAT_MAX_LEVELS = 16;
+
+// An 8-bit image and its box filtered mips, as the baker samples them
+struct SplatImage
+{
+  int Width, Height, Channels;
+  std::vector<unsigned char> Texels;
+};
+
+// The terrain's splat (plane.fs: texture1 and texture2 blended by height,
+// then the grass colour blended in by mask) baked into a virtual texture,
+// so the fragment shader does one page table lookup and one fetch instead
+// of blending three textures per pixel (splat.glsl).
+//
+// The virtual texture covers the terrain's texture coordinates at Size^2
+// texels, split into pages of SPLAT_PAGE^2 texels with a mip chain of
+// pages down to a single one. Update picks the pages the camera needs,
+// each at about one texel per pixel by its distance, like Terrain picks
+// its LOD, and queues the missing ones for a baker thread, which blends
+// them on the CPU from the source images into a small bounded list of
+// finished pages, like TerrainTileCache loads its tiles. Update uploads the
+// finished pages into free slots of an atlas texture or ones not used this
+// frame, least recently used first. The page table texture, one mip level
+// per page level, points every page at its own slot or its nearest
+// resident ancestor. The coarsest levels are baked up front and never
+// evicted, so every page has something to show while its detail is baked.
+class SplatTexture
+{
+public:
+  GLuint PageTable, Atlas;
+  int Size;          // virtual texels per side at level 0, a power of two
+  int Levels;        // page levels, level l has (Size / SPLAT_PAGE) >> l pages per side
+  int AtlasPages;    // slots per atlas side
+  int PagesPerFrame; // finished pages the baker stages, uploaded per Update at most
+  glm::vec3 Position, Scale; // the terrain's transform, as Plane and Terrain use it
+
+  // Loads the layers, the mask and the heightmap, bakes the coarsest levels and starts the baker
+  SplatTexture(const char *texture1, const char *texture2, const char *mask, const char *heightmap, glm::vec3 position,
+               glm::vec3 scale, int size, int atlasPages, int pagesPerFrame = 8);
+  ~SplatTexture();
+  bool Valid() const { return this->Atlas != 0; }
+  // Selects the pages visible from the camera, uploads the pages baked since
+  // the last call, updates the page table and queues this frame's misses for
+  // the baker, once per frame before drawing
+  void Update(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &viewPos, float viewportHeight);
+  // Sets the splat uniforms of a plane.fs shader in use, once after it is created
+  void SetUniforms(Shader *shader, int pageUnit, int atlasUnit) const;
+  // Binds the page table and the atlas to the units given to SetUniforms
+  void Bind(int pageUnit, int atlasUnit) const;
+  // Pages resident in the atlas
+  int ResidentCount() const { return (int)this->Lookup.size(); }
+  // Stops the baker, deletes the textures and the source images
+  void Release();
+
+private:
+  struct Slot
+  {
+    long long Key; // -1 when free
+    unsigned long LastUsed;
+    bool Pinned;   // coarsest levels, never evicted
+  };
+  std::vector<SplatImage> Layer1, Layer2, Mask; // mip chains
+  SplatImage Heights;
+  std::vector<Slot> SlotTable;
+  std::unordered_map<long long, int> Lookup; // resident page -> slot
+  std::vector<unsigned char> Entries[SPLAT_MAX_LEVELS]; // page table levels, RGBA
+  unsigned long Frame;
+
+  // shared with the baker
+  std::thread Baker;
+  std::mutex Mutex;
+  std::condition_variable Wake;
+  std::deque<long long> Queue;
+  std::vector<std::pair<long long, std::vector<unsigned char> > > Baked;
+  std::unordered_set<long long> InFlight; // queued or baking
+  bool Quit;
+
+  SplatTexture(const SplatTexture &);
+  SplatTexture &operator=(const SplatTexture &);
+  static long long key(int level, int x, int y);
+  int pagesAt(int level) const { return (this->Size / SPLAT_PAGE) >> level; }
+  int acquireSlot(long long key, bool pinned);
+  void bake(long long key, unsigned char *texels) const;
+  bool upload(long long key, const unsigned char *texels, bool pinned);
+  void updatePageTable();
+  void run();
+};
+
+#endif
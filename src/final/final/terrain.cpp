@@ -0,0 +1,273 @@
+#include "terrain.h"
+#include "terrain_tiles.h"
+#include "height_pyramid.h"
+
+#include <algorithm>
+
+namespace
+{
+  // morphing starts at this fraction of the way from the previous range to a level's own
+  const float MORPH_START = 0.7f;
+}
+
+Terrain::Terrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const HeightPyramid &heights, float lodDistance)
+  : Object(pos, size, color), VAO(0), GridVBO(0), GridEBO(0), InstanceVBO(0), HeightTexture(0), Tiles(NULL), Width(0),
+    Height(0), Levels(0), LodDistance(lodDistance), IndexCount(0),
+    NormalMatrixLocation("normalMatrix"), Program(0)
+{
+  if (!heights.Valid())
+    return;
+  this->Width = heights.Width;
+  this->Height = heights.Height;
+  std::vector<size_t> offsets = NodeHeights(heights, this->OwnedHeights);
+  this->Levels = offsets.size();
+  for (int i = 0; i < this->Levels; i++)
+  {
+    glm::ivec2 count = NodeCount(this->Width, this->Height, i);
+    this->LevelData[i].Columns = count.x;
+    this->LevelData[i].Rows = count.y;
+    this->LevelData[i].Heights = &this->OwnedHeights[offsets[i]];
+  }
+  this->HeightTexture = CreateHeightTexture(heights);
+  this->init(lodDistance);
+}
+
+Terrain::Terrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, TerrainTileCache *tiles, float lodDistance)
+  : Object(pos, size, color), VAO(0), GridVBO(0), GridEBO(0), InstanceVBO(0), HeightTexture(0), Tiles(tiles), Width(0),
+    Height(0), Levels(0), LodDistance(lodDistance), IndexCount(0),
+    NormalMatrixLocation("normalMatrix"), Program(0)
+{
+  if (!tiles->Valid())
+    return;
+  this->Width = tiles->Header.Width;
+  this->Height = tiles->Header.Height;
+  this->Levels = tiles->Header.Levels;
+  for (int i = 0; i < this->Levels; i++)
+  {
+    this->LevelData[i].Columns = tiles->Header.NodesX[i];
+    this->LevelData[i].Rows = tiles->Header.NodesZ[i];
+    this->LevelData[i].Heights = tiles->NodeHeights(i);
+  }
+  this->init(lodDistance);
+}
+
+void Terrain::init(float lodDistance)
+{
+  for (int i = 0; i < this->Levels; i++)
+    this->Ranges[i] = lodDistance * (float)(1 << i);
+  // the root is always in range
+  this->Ranges[this->Levels - 1] = 1e30f;
+
+  // the shared patch: (TERRAIN_GRID + 1)^2 grid points, wound like Plane
+  std::vector<glm::vec2> points;
+  points.reserve((TERRAIN_GRID + 1) * (TERRAIN_GRID + 1));
+  for (int i = 0; i <= TERRAIN_GRID; i++)
+    for (int k = 0; k <= TERRAIN_GRID; k++)
+      points.push_back(glm::vec2((float)k, (float)i));
+  std::vector<unsigned short> indices;
+  indices.reserve(TERRAIN_GRID * TERRAIN_GRID * 6);
+  for (int i = 0; i < TERRAIN_GRID; i++)
+  {
+    for (int k = 0; k < TERRAIN_GRID; k++)
+    {
+      unsigned short v1 = k + i * (TERRAIN_GRID + 1), v2 = k + (i + 1) * (TERRAIN_GRID + 1);
+      unsigned short v3 = (k + 1) + (i + 1) * (TERRAIN_GRID + 1), v4 = (k + 1) + i * (TERRAIN_GRID + 1);
+      unsigned short quad[6] = {v1, v2, v3, v1, v3, v4};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+  this->IndexCount = indices.size();
+
+  glGenVertexArrays(1, &this->VAO);
+  glGenBuffers(1, &this->GridVBO);
+  glGenBuffers(1, &this->GridEBO);
+  glGenBuffers(1, &this->InstanceVBO);
+  glBindVertexArray(this->VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, this->GridVBO);
+  glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(glm::vec2), &points[0], GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->GridEBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, this->InstanceVBO);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void *)offsetof(TerrainInstance, Node));
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void *)offsetof(TerrainInstance, Tile));
+  glVertexAttribDivisor(2, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+int Terrain::LevelCount(int width, int height)
+{
+  int levels = 1;
+  while ((TERRAIN_GRID << (levels - 1)) < std::max(width, height) - 1 && levels < TERRAIN_MAX_LEVELS)
+    levels++;
+  return levels;
+}
+
+glm::ivec2 Terrain::NodeCount(int width, int height, int level)
+{
+  int size = TERRAIN_GRID << level;
+  return glm::ivec2(std::max((width - 2) / size + 1, 1), std::max((height - 2) / size + 1, 1));
+}
+
+std::vector<size_t> Terrain::NodeHeights(const HeightPyramid &heights, std::vector<float> &out)
+{
+  int levels = LevelCount(heights.Width, heights.Height);
+  std::vector<size_t> offsets(levels);
+  out.clear();
+  // the node counts equal the cell counts, past the pyramid's top both are one
+  for (int l = 0; l < levels; l++)
+  {
+    offsets[l] = out.size();
+    glm::ivec2 count = heights.CellCount(l + TERRAIN_GRID_LEVEL);
+    const unsigned char *cells = heights.CellHeights(l + TERRAIN_GRID_LEVEL);
+    out.insert(out.end(), cells, cells + 2 * (size_t)count.x * count.y);
+  }
+  return offsets;
+}
+
+unsigned int Terrain::CreateHeightTexture(const HeightPyramid &heights)
+{
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, heights.Width, heights.Height, 0, GL_RED, GL_UNSIGNED_BYTE, heights.Texels());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+void Terrain::Select(const Frustum &frustum, const glm::vec3 &viewPos)
+{
+  this->Selection.clear();
+  if (this->Levels > 0)
+    this->select(this->Levels - 1, 0, 0, frustum, viewPos);
+}
+
+// False when the node is beyond the range of its level and its parent has to
+// cover the area, true when it was drawn, culled or lies past the heightmap
+bool Terrain::select(int level, int column, int row, const Frustum &frustum, const glm::vec3 &viewPos)
+{
+  if (column >= this->LevelData[level].Columns || row >= this->LevelData[level].Rows)
+    return true;
+  AABB box = this->bounds(level, column, row);
+  float distance = box.Distance(viewPos);
+  if (distance > this->Ranges[level])
+    return false;
+  if (frustum.Test(box) == Frustum::OUTSIDE)
+    return true;
+  if (level == 0 || distance > this->Ranges[level - 1])
+  {
+    this->add(level, column, row);
+    return true;
+  }
+  for (int c = 0; c < 4; c++)
+  {
+    int x = 2 * column + c % 2, z = 2 * row + c / 2;
+    // a child out of its range is drawn at its own size but fully morphed,
+    // which is the geometry of this level
+    if (!this->select(level - 1, x, z, frustum, viewPos) && frustum.Test(this->bounds(level - 1, x, z)) != Frustum::OUTSIDE)
+      this->add(level - 1, x, z);
+  }
+  return true;
+}
+
+void Terrain::add(int level, int column, int row)
+{
+  int size = TERRAIN_GRID << level;
+  TerrainInstance instance;
+  instance.Node = glm::vec4((float)(column * size), (float)(row * size), (float)(1 << level), (float)level);
+  instance.Tile = glm::vec4(0.0f);
+  if (this->Tiles)
+  {
+    // the tile of the node's own mip, or the finest resident one above it
+    // while that loads. The coarsest mip is always resident.
+    int mip = level;
+    int layer = -1;
+    for (; mip < this->Levels && layer < 0; mip++)
+      layer = this->Tiles->Acquire(mip, (column * size >> mip) / TERRAIN_TILE, (row * size >> mip) / TERRAIN_TILE);
+    if (layer < 0)
+      return;
+    mip--;
+    instance.Tile = glm::vec4((float)layer, (float)mip, (float)((column * size >> mip) / TERRAIN_TILE * TERRAIN_TILE),
+                              (float)((row * size >> mip) / TERRAIN_TILE * TERRAIN_TILE));
+  }
+  this->Selection.push_back(instance);
+}
+
+AABB Terrain::bounds(int level, int column, int row) const
+{
+  const TerrainLevel &data = this->LevelData[level];
+  const float *heights = data.Heights + 2 * (column + row * data.Columns);
+  int size = TERRAIN_GRID << level;
+  glm::vec3 min((float)(column * size), heights[0], (float)(row * size));
+  glm::vec3 max((float)std::min((column + 1) * size, this->Width - 1), heights[1], (float)std::min((row + 1) * size, this->Height - 1));
+  return AABB(this->Position + min * this->Size, this->Position + max * this->Size);
+}
+
+void Terrain::Draw(Shader *shader)
+{
+  if (this->Selection.empty())
+    return;
+  shader->use();
+  glm::mat4 model(1.0f);
+  model = glm::translate(model, this->Position);
+  model = glm::scale(model, this->Size);
+  glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
+  glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+  glUniformMatrix3fv(this->NormalMatrixLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+  // the rest never changes after init, once per program
+  if (shader->ID != this->Program)
+  {
+    glUniform2f(glGetUniformLocation(shader->ID, "heightMapSize"), (float)this->Width, (float)this->Height);
+    // start and end of the morph of every level, in world units
+    glm::vec2 morph[TERRAIN_MAX_LEVELS];
+    for (int i = 0; i < this->Levels; i++)
+    {
+      float previous = i > 0 ? this->Ranges[i - 1] : 0.0f;
+      morph[i] = glm::vec2(previous + (this->Ranges[i] - previous) * MORPH_START, this->Ranges[i]);
+    }
+    glUniform2fv(glGetUniformLocation(shader->ID, "morphRanges"), this->Levels, glm::value_ptr(morph[0]));
+    if (this->Tiles)
+    {
+      glUniform1i(glGetUniformLocation(shader->ID, "heightTiles"), HEIGHT_TEXTURE_UNIT);
+      glUniform1f(glGetUniformLocation(shader->ID, "tileStored"), (float)TERRAIN_TILE_STORED);
+    }
+    else
+      glUniform1i(glGetUniformLocation(shader->ID, "heightMap"), HEIGHT_TEXTURE_UNIT);
+    this->Program = shader->ID;
+  }
+  if (this->Tiles)
+    this->Tiles->Bind(HEIGHT_TEXTURE_UNIT);
+  else
+  {
+    glActiveTexture(GL_TEXTURE0 + HEIGHT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, this->HeightTexture);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, this->InstanceVBO);
+  glBufferData(GL_ARRAY_BUFFER, this->Selection.size() * sizeof(TerrainInstance), &this->Selection[0], GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(this->VAO);
+  glDrawElementsInstanced(GL_TRIANGLES, this->IndexCount, GL_UNSIGNED_SHORT, (void *)0, this->Selection.size());
+  glBindVertexArray(0);
+}
+
+void Terrain::Release()
+{
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteBuffers(1, &this->GridVBO);
+  glDeleteBuffers(1, &this->GridEBO);
+  glDeleteBuffers(1, &this->InstanceVBO);
+  glDeleteTextures(1, &this->HeightTexture);
+  this->VAO = this->GridVBO = this->GridEBO = this->InstanceVBO = this->HeightTexture = 0;
+}
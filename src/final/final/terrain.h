@@ -0,0 +1,106 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include "object.h"
+#include "culling.h"
+
+class TerrainTileCache;
+class HeightPyramid;
+
+// Quads per side of the shared grid patch, the size of a leaf node in texels.
+// A node of level L is a cell of HeightPyramid level L + TERRAIN_GRID_LEVEL.
+const int TERRAIN_GRID_LEVEL = 5;
+const int TERRAIN_GRID = 1 << TERRAIN_GRID_LEVEL;
+// Size of the morphRanges array in terrain.vs
+const int TERRAIN_MAX_LEVELS = 12;
+
+// The nodes of one level of the quadtree: a grid of squares of
+// TERRAIN_GRID << level texels, with the min and max height of each
+struct TerrainLevel
+{
+  int Columns, Rows;
+  const float *Heights; // min, max per node, row by row
+};
+
+// One selected node: first texel (x, z), texels per grid quad and level,
+// then for streamed terrains the tile cache layer, the mip level of the
+// tile and its first texel (x, z) in that mip
+struct TerrainInstance
+{
+  glm::vec4 Node;
+  glm::vec4 Tile;
+};
+
+// Heightmap terrain drawn with continuous distance-dependent level of detail
+// (CDLOD, Strugar 2010). A quadtree over the heightmap is walked every frame
+// and each selected node is drawn as one instance of the same grid patch,
+// scaled to the node's size. Level L is used up to LodDistance * 2^L from
+// the camera. Over the last 30% of that range terrain.vs morphs the odd
+// vertices onto the next coarser grid, so levels meet without cracks or
+// popping. Heights come from a texture and the nodes carry their min/max
+// heights for frustum culling. The number of triangles therefore depends on
+// the view distance and screen, not on the heightmap size.
+//
+// A terrain is either loaded whole from a heightmap or streamed from a
+// tile file (see TerrainTileCache). Nodes of level L then read mip L of the
+// heightmap, which has exactly one texel per grid point, from the tile
+// cache, falling back to a coarser resident tile while theirs loads.
+class Terrain : public Object
+{
+public:
+  unsigned int VAO, GridVBO, GridEBO, InstanceVBO;
+  unsigned int HeightTexture; // whole heightmap, not streamed only
+  TerrainTileCache *Tiles;    // streamed only, not owned
+  int Width, Height; // of the heightmap, in texels
+  int Levels;
+  float LodDistance;
+  TerrainLevel LevelData[TERRAIN_MAX_LEVELS];
+
+  // Uploads a whole heightmap and takes the node heights from its pyramid.
+  // Like Plane, one texel per unit and the 8-bit value as height.
+  Terrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const HeightPyramid &heights, float lodDistance);
+  // Streams the heightmap through a tile cache, draw with terrain.vs built with TERRAIN_STREAMED
+  Terrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, TerrainTileCache *tiles, float lodDistance);
+  // Picks the nodes to draw for a camera, skipping the ones outside the frustum
+  void Select(const Frustum &frustum, const glm::vec3 &viewPos);
+  // Draws the last selection in one instanced draw with terrain.vs and plane.fs
+  void Draw(Shader *shader);
+  // Number of patches in the last selection
+  int SelectedCount() const { return (int)this->Selection.size(); }
+  // Deletes the GL objects
+  void Release();
+
+  // Levels of the quadtree whose root covers a heightmap
+  static int LevelCount(int width, int height);
+  // Nodes per row and column of a level
+  static glm::ivec2 NodeCount(int width, int height, int level);
+  // Min and max heights of the nodes of all levels, level 0 first, as
+  // TerrainLevel::Heights. Returns where each level starts, in floats.
+  static std::vector<size_t> NodeHeights(const HeightPyramid &heights, std::vector<float> &out);
+  // The R8 height texture of a heightmap, bound to HEIGHT_TEXTURE_UNIT by
+  // the terrains that sample it
+  static unsigned int CreateHeightTexture(const HeightPyramid &heights);
+
+  static const int HEIGHT_TEXTURE_UNIT = 4;
+
+private:
+  std::vector<TerrainInstance> Selection;
+  std::vector<float> OwnedHeights; // node heights of a terrain loaded whole
+  float Ranges[TERRAIN_MAX_LEVELS];
+  int IndexCount;
+  UniformLocation NormalMatrixLocation;
+  GLuint Program; // the program the constant uniforms were set for
+
+  void init(float lodDistance);
+  bool select(int level, int column, int row, const Frustum &frustum, const glm::vec3 &viewPos);
+  void add(int level, int column, int row);
+  AABB bounds(int level, int column, int row) const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#version 330 core
+layout (location = 0) in vec2 aGrid; // grid point of the shared patch, 0 to TERRAIN_GRID
+layout (location = 1) in vec4 aNode; // per node: first texel (x, z), texels per grid quad, level
+#ifdef TERRAIN_STREAMED
+layout (location = 2) in vec4 aTile; // per node: tile cache layer, mip, first texel (x, z) of the tile in the mip
+#endif
+
+out vec3 Pos;
+
+out VS_OUT {
+    vec3 FragPos;
+	vec3 Normal;
+	vec2 TexCoord;
+} vs_out;
+
+#include "frame_data.glsl"
+uniform mat4 model;
+uniform mat3 normalMatrix;
+#ifdef TERRAIN_STREAMED
+uniform sampler2DArray heightTiles;
+uniform float tileStored; // texels per stored tile side (TERRAIN_TILE_STORED)
+#else
+uniform sampler2D heightMap;
+#endif
+uniform vec2 heightMapSize;
+// start and end distance of the morph to the next level (TERRAIN_MAX_LEVELS)
+uniform vec2 morphRanges[12];
+
+// height of the terrain at a texel position, as Plane builds it
+#ifdef TERRAIN_STREAMED
+float Height(vec2 texel)
+{
+    // the stored tile starts one texel before the tile
+    vec2 mipTexel = texel / exp2(aTile.y) - aTile.zw + 1.0;
+    return textureLod(heightTiles, vec3((mipTexel + 0.5) / tileStored, aTile.x), 0.0).r * 255.0;
+}
+#else
+float Height(vec2 texel)
+{
+    return textureLod(heightMap, (texel + 0.5) / heightMapSize, 0.0).r * 255.0;
+}
+#endif
+
+void main()
+{
+    vec2 texel = aNode.xy + aGrid * aNode.z;
+    vec3 world = vec3(model * vec4(texel.x, Height(texel), texel.y, 1.0));
+
+    // move the odd grid points onto the coarser grid as the level's range ends
+    vec2 range = morphRanges[int(aNode.w)];
+    float morph = clamp((distance(world, viewPos) - range.x) / (range.y - range.x), 0.0, 1.0);
+    texel -= fract(aGrid * 0.5) * 2.0 * aNode.z * morph;
+    // patches along the far edges overhang the heightmap
+    texel = min(texel, heightMapSize - 1.0);
+
+    vec3 local = vec3(texel.x, Height(texel), texel.y);
+    // central differences one texel of the sampled mip apart
+#ifdef TERRAIN_STREAMED
+    float step = exp2(aTile.y);
+#else
+    float step = 1.0;
+#endif
+    vec3 normal = vec3(Height(texel - vec2(step, 0.0)) - Height(texel + vec2(step, 0.0)), 2.0 * step,
+                       Height(texel - vec2(0.0, step)) - Height(texel + vec2(0.0, step)));
+
+    gl_Position = projection * view * model * vec4(local, 1.0);
+	vs_out.FragPos = vec3(model * vec4(local, 1.0));
+	vs_out.Normal = normalMatrix * normal;
+    Pos = local;
+    vs_out.TexCoord = texel / heightMapSize;
+}
@@ -0,0 +1,109 @@
+#include "terrain_normals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef TERRAIN_NORMALS_SSE
+#include <emmintrin.h>
+#endif
+
+#include <glad/glad.h>
+#include "util.h"
+
+namespace
+{
+  // The filter sums 1 + 2 + 1 weighted differences taken two texels apart,
+  // so it is this many times the slope
+  const float SOBEL_SCALE = 8.0f;
+
+  inline glm::vec3 &element(glm::vec3 *base, size_t stride, size_t index)
+  {
+    return *(glm::vec3 *)((char *)base + stride * index);
+  }
+
+  // One texel of a row, between the rows above and below it (clamped)
+  void texel(const unsigned char *up, const unsigned char *row, const unsigned char *down, int x, int width,
+             glm::vec3 &normal, glm::vec3 *tangent)
+  {
+    int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+    // the height falls towards +x and +z by these, times SOBEL_SCALE
+    float gx = (float)((up[l] + 2 * row[l] + down[l]) - (up[r] + 2 * row[r] + down[r]));
+    float gz = (float)((up[l] + 2 * up[x] + up[r]) - (down[l] + 2 * down[x] + down[r]));
+    normal = glm::vec3(gx, SOBEL_SCALE, gz) / std::sqrt(gx * gx + SOBEL_SCALE * SOBEL_SCALE + gz * gz);
+    if (tangent)
+      *tangent = glm::vec3(SOBEL_SCALE, -gx, 0.0f) / std::sqrt(SOBEL_SCALE * SOBEL_SCALE + gx * gx);
+  }
+
+#ifdef TERRAIN_NORMALS_SSE
+  // Four bytes as four floats
+  inline __m128 load4(const unsigned char *bytes)
+  {
+    int bits;
+    std::memcpy(&bits, bytes, sizeof(bits));
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero));
+  }
+
+  // 1 / sqrt(x), the estimate refined with one Newton step to about float precision
+  inline __m128 inverseSqrt(__m128 x)
+  {
+    __m128 estimate = _mm_rsqrt_ps(x);
+    __m128 half = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+    return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(half, _mm_mul_ps(estimate, estimate))));
+  }
+#endif
+}
+
+void TerrainNormals::Generate(const unsigned char *heights, int width, int height, glm::vec3 *normals, glm::vec3 *tangents,
+                              size_t stride)
+{
+  if (width <= 0 || height <= 0)
+    return;
+  parallel_for(height, [&](int begin, int end) {
+    for (int z = begin; z < end; z++)
+    {
+      const unsigned char *up = heights + (size_t)std::max(z - 1, 0) * width;
+      const unsigned char *row = heights + (size_t)z * width;
+      const unsigned char *down = heights + (size_t)std::min(z + 1, height - 1) * width;
+      size_t first = (size_t)z * width;
+      int x = 0;
+#ifdef TERRAIN_NORMALS_SSE
+      if (width > 4)
+      {
+        // the first texel clamps its left neighbours, the vector loop reads up to x + 4
+        texel(up, row, down, 0, width, element(normals, stride, first), tangents ? &element(tangents, stride, first) : NULL);
+        const __m128 two = _mm_set1_ps(2.0f), scale = _mm_set1_ps(SOBEL_SCALE), scale2 = _mm_set1_ps(SOBEL_SCALE * SOBEL_SCALE);
+        const __m128 zero = _mm_setzero_ps();
+        for (x = 1; x + 4 < width; x += 4)
+        {
+          __m128 ul = load4(up + x - 1), uc = load4(up + x), ur = load4(up + x + 1);
+          __m128 rl = load4(row + x - 1), rr = load4(row + x + 1);
+          __m128 dl = load4(down + x - 1), dc = load4(down + x), dr = load4(down + x + 1);
+          __m128 gx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(ul, dl), _mm_mul_ps(two, rl)),
+                                 _mm_add_ps(_mm_add_ps(ur, dr), _mm_mul_ps(two, rr)));
+          __m128 gz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(ul, ur), _mm_mul_ps(two, uc)),
+                                 _mm_add_ps(_mm_add_ps(dl, dr), _mm_mul_ps(two, dc)));
+          __m128 gx2 = _mm_mul_ps(gx, gx);
+          __m128 inverse = inverseSqrt(_mm_add_ps(_mm_add_ps(gx2, scale2), _mm_mul_ps(gz, gz)));
+          float nx[4], ny[4], nz[4];
+          _mm_storeu_ps(nx, _mm_mul_ps(gx, inverse));
+          _mm_storeu_ps(ny, _mm_mul_ps(scale, inverse));
+          _mm_storeu_ps(nz, _mm_mul_ps(gz, inverse));
+          for (int i = 0; i < 4; i++)
+            element(normals, stride, first + x + i) = glm::vec3(nx[i], ny[i], nz[i]);
+          if (tangents)
+          {
+            inverse = inverseSqrt(_mm_add_ps(gx2, scale2));
+            _mm_storeu_ps(nx, _mm_mul_ps(scale, inverse));
+            _mm_storeu_ps(ny, _mm_mul_ps(_mm_sub_ps(zero, gx), inverse));
+            for (int i = 0; i < 4; i++)
+              element(tangents, stride, first + x + i) = glm::vec3(nx[i], ny[i], 0.0f);
+          }
+        }
+      }
+#endif
+      for (; x < width; x++)
+        texel(up, row, down, x, width, element(normals, stride, first + x), tangents ? &element(tangents, stride, first + x) : NULL);
+    }
+  });
+}
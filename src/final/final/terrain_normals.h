@@ -0,0 +1,32 @@
+#ifndef TERRAIN_NORMALS_H
+#define TERRAIN_NORMALS_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_NORMALS_SSE 1
+#endif
+
+// Normals and tangents of a heightmap grid, one per texel, with the 8-bit
+// value as height and one unit between texels as Plane builds it. The
+// slopes come from the 3x3 Sobel filter around each texel, which smooths
+// along one axis while it differentiates along the other, with the texels
+// outside the heightmap clamped to its edges. Rows are split over all cores
+// and computed four texels at a time with SSE.
+class TerrainNormals
+{
+public:
+  // Writes the unit normal and the unit tangent along +x (the direction of
+  // the u texture coordinate) of every texel, row by row. Each output is
+  // advanced by stride bytes per texel, so they can go straight into an
+  // interleaved vertex array. tangents may be NULL.
+  static void Generate(const unsigned char *heights, int width, int height, glm::vec3 *normals, glm::vec3 *tangents,
+                       size_t stride = sizeof(glm::vec3));
+
+private:
+  TerrainNormals() {}
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "terrain_tess.h"
+#include "terrain.h"
+#include "height_pyramid.h"
+
+#include <vector>
+
+TessellatedTerrain::TessellatedTerrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const HeightPyramid &heights, float triangleSize)
+  : Object(pos, size, color), VAO(0), VBO(0), HeightTexture(0), Width(0), Height(0), PatchCount(0), TriangleSize(triangleSize),
+    NormalMatrixLocation("normalMatrix"), ViewportLocation("viewportSize"), Program(0)
+{
+  if (!heights.Valid())
+    return;
+  this->Width = heights.Width;
+  this->Height = heights.Height;
+
+  // per patch: first texel (x, z) and the height range of the texels it covers
+  glm::ivec2 count = heights.CellCount(TERRAIN_TESS_PATCH_LEVEL);
+  const unsigned char *cells = heights.CellHeights(TERRAIN_TESS_PATCH_LEVEL);
+  std::vector<glm::vec4> patches;
+  patches.reserve((size_t)count.x * count.y);
+  for (int z = 0; z < count.y; z++)
+    for (int x = 0; x < count.x; x++)
+    {
+      const unsigned char *cell = cells + 2 * (x + (size_t)z * count.x);
+      patches.push_back(glm::vec4((float)(x * TERRAIN_TESS_PATCH), (float)(z * TERRAIN_TESS_PATCH), (float)cell[0], (float)cell[1]));
+    }
+  this->PatchCount = patches.size();
+  this->HeightTexture = Terrain::CreateHeightTexture(heights);
+
+  glGenVertexArrays(1, &this->VAO);
+  glGenBuffers(1, &this->VBO);
+  glBindVertexArray(this->VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+  glBufferData(GL_ARRAY_BUFFER, patches.size() * sizeof(glm::vec4), patches.empty() ? NULL : &patches[0], GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TessellatedTerrain::Draw(Shader *shader, glm::vec2 viewport)
+{
+  if (this->PatchCount == 0)
+    return;
+  shader->use();
+  glm::mat4 model(1.0f);
+  model = glm::translate(model, this->Position);
+  model = glm::scale(model, this->Size);
+  glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
+  glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+  glUniformMatrix3fv(this->NormalMatrixLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+  glUniform2f(this->ViewportLocation.Get(shader->ID), viewport.x, viewport.y);
+  // the rest never changes, once per program
+  if (shader->ID != this->Program)
+  {
+    glUniform2f(glGetUniformLocation(shader->ID, "heightMapSize"), (float)this->Width, (float)this->Height);
+    glUniform1f(glGetUniformLocation(shader->ID, "patchSize"), (float)TERRAIN_TESS_PATCH);
+    glUniform1f(glGetUniformLocation(shader->ID, "tessTriangleSize"), this->TriangleSize);
+    glUniform1i(glGetUniformLocation(shader->ID, "heightMap"), Terrain::HEIGHT_TEXTURE_UNIT);
+    this->Program = shader->ID;
+  }
+  glActiveTexture(GL_TEXTURE0 + Terrain::HEIGHT_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_2D, this->HeightTexture);
+
+  glPatchParameteri(GL_PATCH_VERTICES, 1);
+  glBindVertexArray(this->VAO);
+  glDrawArrays(GL_PATCHES, 0, this->PatchCount);
+  glBindVertexArray(0);
+}
+
+void TessellatedTerrain::Release()
+{
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteBuffers(1, &this->VBO);
+  glDeleteTextures(1, &this->HeightTexture);
+  this->VAO = this->VBO = this->HeightTexture = 0;
+  this->PatchCount = 0;
+}
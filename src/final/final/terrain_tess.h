@@ -0,0 +1,48 @@
+#ifndef TERRAIN_TESS_H
+#define TERRAIN_TESS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include "object.h"
+
+class HeightPyramid;
+
+// Texels per side of a patch, at most the tessellation level every GL 4.0
+// implementation supports (64), so the finest level is one quad per texel.
+// A patch is a cell of HeightPyramid level TERRAIN_TESS_PATCH_LEVEL.
+const int TERRAIN_TESS_PATCH_LEVEL = 6;
+const int TERRAIN_TESS_PATCH = 1 << TERRAIN_TESS_PATCH_LEVEL;
+
+// Heightmap terrain drawn with hardware tessellation (GL 4.0). The CPU mesh
+// is one point per patch of TERRAIN_TESS_PATCH^2 texels holding its corner
+// and height range. terrain_tess.tcs culls each patch against the frustum
+// and splits its edges by their size on screen (tessellation.glsl), and
+// terrain_tess.tes displaces the generated vertices from the height texture
+// like terrain.vs. It feeds plane.fs like Plane and Terrain do.
+class TessellatedTerrain : public Object
+{
+public:
+  unsigned int VAO, VBO, HeightTexture;
+  int Width, Height; // of the heightmap, in texels
+  int PatchCount;
+  float TriangleSize; // wanted edge length of the generated triangles, in pixels, set before the first draw
+
+  // Uploads a whole heightmap like Terrain and takes the patch heights from its
+  // pyramid. Like Plane, one texel per unit and the 8-bit value as height.
+  TessellatedTerrain(glm::vec3 pos, glm::vec3 size, glm::vec3 color, const HeightPyramid &heights, float triangleSize);
+  // Draws all patches with the terrain_tess shaders and plane.fs for a viewport in pixels
+  void Draw(Shader *shader, glm::vec2 viewport);
+  // Deletes the GL objects
+  void Release();
+
+  // Whether the context can tessellate
+  static bool Supported() { return GLAD_GL_VERSION_4_0 && glPatchParameteri != NULL; }
+
+private:
+  UniformLocation NormalMatrixLocation, ViewportLocation;
+  GLuint Program; // the program the constant uniforms were set for
+};
+
+#endif
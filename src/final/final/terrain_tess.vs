@@ -0,0 +1,9 @@
+#version 400 core
+layout (location = 0) in vec4 aPatch; // first texel (x, z), min and max height of the patch
+
+out vec4 vPatch;
+
+void main()
+{
+    vPatch = aPatch;
+}
@@ -0,0 +1,337 @@
+#include "terrain_tiles.h"
+#include "height_pyramid.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+#include <stb_image.h>
+
+namespace
+{
+  const int TILE_FILE_VERSION = 2;
+  const size_t TILE_BYTES = (size_t)TERRAIN_TILE_STORED * TERRAIN_TILE_STORED;
+  // tiles the loader may stage ahead of Update
+  const size_t MAX_STAGED = 32;
+
+  // Texels per side of mip m of a heightmap side
+  int mipSize(int size, int mip)
+  {
+    return ((size - 1) >> mip) + 1;
+  }
+}
+
+bool TerrainTileCache::Bake(const char *heightmap, const char *file)
+{
+  int width, height;
+  unsigned char *image = stbi_load(heightmap, &width, &height, 0, STBI_grey);
+  if (!image)
+  {
+    std::cout << "ERROR::TERRAIN_TILES: Failed to load heightmap " << heightmap << std::endl;
+    return false;
+  }
+
+  HeightPyramid pyramid(image, width, height, glm::vec3(0.0f), glm::vec3(1.0f));
+  if (!pyramid.Valid())
+  {
+    stbi_image_free(image);
+    return false;
+  }
+  std::vector<float> nodeHeights;
+  std::vector<size_t> nodeOffsets = Terrain::NodeHeights(pyramid, nodeHeights);
+  TerrainTileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, "TTIL", 4);
+  header.Version = TILE_FILE_VERSION;
+  header.Width = width;
+  header.Height = height;
+  header.Levels = nodeOffsets.size();
+  header.Tile = TERRAIN_TILE;
+  long long sourceTime, sourceSize;
+  unsigned long long sourceHash;
+  if (!file_info(heightmap, &sourceTime, &sourceSize) || !hash_file(heightmap, &sourceHash))
+  {
+    std::cout << "ERROR::TERRAIN_TILES: Failed to read " << heightmap << std::endl;
+    stbi_image_free(image);
+    return false;
+  }
+  header.SourceTime = sourceTime;
+  header.SourceSize = sourceSize;
+  header.SourceHash = sourceHash;
+  int64_t offset = sizeof(header);
+  for (int l = 0; l < header.Levels; l++)
+  {
+    glm::ivec2 nodes = Terrain::NodeCount(width, height, l);
+    header.NodesX[l] = nodes.x;
+    header.NodesZ[l] = nodes.y;
+    header.NodeOffset[l] = offset + nodeOffsets[l] * sizeof(float);
+  }
+  offset += nodeHeights.size() * sizeof(float);
+  for (int m = 0; m < header.Levels; m++)
+  {
+    header.TilesX[m] = std::max((mipSize(width, m) - 2) / TERRAIN_TILE + 1, 1);
+    header.TilesZ[m] = std::max((mipSize(height, m) - 2) / TERRAIN_TILE + 1, 1);
+    header.TileOffset[m] = offset;
+    offset += (int64_t)header.TilesX[m] * header.TilesZ[m] * TILE_BYTES;
+  }
+
+  std::ofstream out(file, std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    std::cout << "ERROR::TERRAIN_TILES: Failed to write " << file << std::endl;
+    stbi_image_free(image);
+    return false;
+  }
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)&nodeHeights[0], nodeHeights.size() * sizeof(float));
+  std::vector<unsigned char> tile(TILE_BYTES);
+  for (int m = 0; m < header.Levels; m++)
+  {
+    int lastX = mipSize(width, m) - 1, lastZ = mipSize(height, m) - 1;
+    for (int tz = 0; tz < header.TilesZ[m]; tz++)
+      for (int tx = 0; tx < header.TilesX[m]; tx++)
+      {
+        // every 2^m-th texel, the apron and the overhang clamped to the edges
+        for (int j = 0; j < TERRAIN_TILE_STORED; j++)
+        {
+          int z = std::min(std::max(tz * TERRAIN_TILE - 1 + j, 0), lastZ);
+          const unsigned char *row = image + (size_t)std::min(z << m, height - 1) * width;
+          for (int i = 0; i < TERRAIN_TILE_STORED; i++)
+          {
+            int x = std::min(std::max(tx * TERRAIN_TILE - 1 + i, 0), lastX);
+            tile[i + j * TERRAIN_TILE_STORED] = row[std::min(x << m, width - 1)];
+          }
+        }
+        out.write((const char *)&tile[0], tile.size());
+      }
+  }
+  stbi_image_free(image);
+  if (!out)
+  {
+    std::cout << "ERROR::TERRAIN_TILES: Failed to write " << file << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TerrainTileCache::Refresh(const char *heightmap, const char *file)
+{
+  long long time, size;
+  if (!file_info(heightmap, &time, &size))
+    return file_info(file, &time, &size); // the heightmap is gone, the tiles are all we have
+  TerrainTileHeader header;
+  std::ifstream in(file, std::ios::binary);
+  if (in && in.read((char *)&header, sizeof(header)) && std::memcmp(header.Magic, "TTIL", 4) == 0 &&
+      header.Version == TILE_FILE_VERSION && header.Tile == TERRAIN_TILE && header.SourceSize == size)
+  {
+    if (header.SourceTime == time)
+      return true;
+    // The timestamp moved (copy, checkout), only bake again if the content changed
+    unsigned long long hash;
+    if (hash_file(heightmap, &hash) && hash == header.SourceHash)
+    {
+      in.close();
+      header.SourceTime = time;
+      std::fstream out(file, std::ios::in | std::ios::out | std::ios::binary);
+      if (!out || !out.write((const char *)&header, sizeof(header)))
+        std::cout << "ERROR::TERRAIN_TILES: Failed to update " << file << std::endl;
+      return true;
+    }
+  }
+  in.close();
+  return Bake(heightmap, file);
+}
+
+TerrainTileCache::TerrainTileCache(const char *file, int slots)
+  : Texture(0), Slots(slots), Frame(1), Quit(false)
+{
+  std::memset(&this->Header, 0, sizeof(this->Header));
+  if (!map_file(file, &this->File))
+    return;
+  if (this->File.size < sizeof(TerrainTileHeader))
+  {
+    std::cout << "ERROR::TERRAIN_TILES: " << file << " is not a tile file" << std::endl;
+    unmap_file(&this->File);
+    return;
+  }
+  std::memcpy(&this->Header, this->File.data, sizeof(this->Header));
+  const TerrainTileHeader &header = this->Header;
+  int last = header.Levels - 1;
+  if (std::memcmp(header.Magic, "TTIL", 4) != 0 || header.Version != TILE_FILE_VERSION || header.Tile != TERRAIN_TILE ||
+      header.Levels < 1 || header.Levels > TERRAIN_MAX_LEVELS ||
+      this->File.size < (size_t)header.TileOffset[last] + (size_t)header.TilesX[last] * header.TilesZ[last] * TILE_BYTES)
+  {
+    std::cout << "ERROR::TERRAIN_TILES: " << file << " is not a tile file of this version, bake it again" << std::endl;
+    unmap_file(&this->File);
+    return;
+  }
+  // the pinned coarsest mip must fit with room to stream
+  int pinned = header.TilesX[last] * header.TilesZ[last];
+  this->Slots = std::max(slots, pinned + 16);
+
+  glGenTextures(1, &this->Texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->Texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, TERRAIN_TILE_STORED, TERRAIN_TILE_STORED, this->Slots, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  Slot empty = {-1, 0, false};
+  this->SlotTable.assign(this->Slots, empty);
+
+  for (int z = 0; z < header.TilesZ[last]; z++)
+    for (int x = 0; x < header.TilesX[last]; x++)
+      this->upload(key(last, x, z), this->tileData(key(last, x, z)), true);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  this->Loader = std::thread(&TerrainTileCache::run, this);
+}
+
+TerrainTileCache::~TerrainTileCache()
+{
+  this->Release();
+}
+
+const float *TerrainTileCache::NodeHeights(int level) const
+{
+  return (const float *)(this->File.data + this->Header.NodeOffset[level]);
+}
+
+int TerrainTileCache::Acquire(int mip, int x, int z)
+{
+  if (mip < 0 || mip >= this->Header.Levels || x < 0 || z < 0 || x >= this->Header.TilesX[mip] || z >= this->Header.TilesZ[mip])
+    return -1;
+  long long k = key(mip, x, z);
+  std::unordered_map<long long, int>::iterator found = this->Lookup.find(k);
+  if (found != this->Lookup.end())
+  {
+    this->SlotTable[found->second].LastUsed = this->Frame;
+    return found->second;
+  }
+  if (this->Missed.insert(k).second)
+    this->Misses.push_back(k);
+  return -1;
+}
+
+void TerrainTileCache::Update()
+{
+  if (!this->Valid())
+    return;
+  std::vector<std::pair<long long, std::vector<unsigned char> > > loaded;
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    loaded.swap(this->Loaded);
+  }
+  if (!loaded.empty())
+  {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->Texture);
+    // a tile that finds no slot is asked for again when still needed
+    for (size_t i = 0; i < loaded.size(); i++)
+      if (!this->Lookup.count(loaded[i].first))
+        this->upload(loaded[i].first, &loaded[i].second[0], false);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    for (size_t i = 0; i < loaded.size(); i++)
+      this->InFlight.erase(loaded[i].first);
+    // tiles still queued but no longer wanted are dropped, this frame's misses replace them
+    for (size_t i = 0; i < this->Queue.size(); i++)
+      this->InFlight.erase(this->Queue[i]);
+    this->Queue.clear();
+    for (size_t i = 0; i < this->Misses.size(); i++)
+      if (!this->Lookup.count(this->Misses[i]) && this->InFlight.insert(this->Misses[i]).second)
+        this->Queue.push_back(this->Misses[i]);
+  }
+  this->Wake.notify_one();
+  this->Misses.clear();
+  this->Missed.clear();
+  this->Frame++;
+}
+
+void TerrainTileCache::Bind(int unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, this->Texture);
+}
+
+void TerrainTileCache::Release()
+{
+  if (this->Loader.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Quit = true;
+    }
+    this->Wake.notify_one();
+    this->Loader.join();
+  }
+  glDeleteTextures(1, &this->Texture);
+  this->Texture = 0;
+  this->Lookup.clear();
+  this->SlotTable.clear();
+  unmap_file(&this->File);
+}
+
+long long TerrainTileCache::key(int mip, int x, int z)
+{
+  return ((long long)mip << 48) | ((long long)z << 24) | (long long)x;
+}
+
+const unsigned char *TerrainTileCache::tileData(long long key) const
+{
+  int mip = (int)(key >> 48), z = (int)((key >> 24) & 0xffffff), x = (int)(key & 0xffffff);
+  return this->File.data + this->Header.TileOffset[mip] + ((size_t)z * this->Header.TilesX[mip] + x) * TILE_BYTES;
+}
+
+// Puts a tile into a free slot or the least recently used one not needed this
+// frame, with the texture array bound
+bool TerrainTileCache::upload(long long key, const unsigned char *data, bool pinned)
+{
+  int victim = -1;
+  for (int i = 0; i < (int)this->SlotTable.size(); i++)
+  {
+    const Slot &slot = this->SlotTable[i];
+    if (slot.Key < 0)
+    {
+      victim = i;
+      break;
+    }
+    if (!slot.Pinned && slot.LastUsed < this->Frame && (victim < 0 || slot.LastUsed < this->SlotTable[victim].LastUsed))
+      victim = i;
+  }
+  if (victim < 0)
+    return false;
+  Slot &slot = this->SlotTable[victim];
+  if (slot.Key >= 0)
+    this->Lookup.erase(slot.Key);
+  slot.Key = key;
+  slot.LastUsed = this->Frame;
+  slot.Pinned = pinned;
+  this->Lookup[key] = victim;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, victim, TERRAIN_TILE_STORED, TERRAIN_TILE_STORED, 1, GL_RED, GL_UNSIGNED_BYTE, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return true;
+}
+
+void TerrainTileCache::run()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  while (true)
+  {
+    this->Wake.wait(lock, [this] { return this->Quit || (!this->Queue.empty() && this->Loaded.size() < MAX_STAGED); });
+    if (this->Quit)
+      return;
+    long long k = this->Queue.front();
+    this->Queue.pop_front();
+    lock.unlock();
+    // the page faults of the mapping happen here, off the render thread
+    const unsigned char *data = this->tileData(k);
+    std::vector<unsigned char> tile(data, data + TILE_BYTES);
+    lock.lock();
+    this->Loaded.push_back(std::make_pair(k, std::move(tile)));
+  }
+}
@@ -0,0 +1,122 @@
+#ifndef TERRAIN_TILES_H
+#define TERRAIN_TILES_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "terrain.h"
+#include "util.h"
+
+// Heightmap texels per tile side, a multiple of TERRAIN_GRID
+const int TERRAIN_TILE = 128;
+// Texels stored per tile side: one before the tile for the normals and two
+// after it for the far edge of the nodes and their normals
+const int TERRAIN_TILE_STORED = TERRAIN_TILE + 3;
+
+// Start of a tile file. It is followed by the node heights of every level
+// and then by the tiles of every mip, row by row, TERRAIN_TILE_STORED^2
+// bytes each. Mip m keeps every 2^m-th texel of the heightmap, so it has
+// one texel per grid point of the quadtree level m.
+struct TerrainTileHeader
+{
+  char Magic[4]; // "TTIL"
+  int32_t Version;
+  int32_t Width, Height; // of the heightmap
+  int32_t Levels;        // quadtree levels and mips
+  int32_t Tile;          // TERRAIN_TILE when written
+  int32_t NodesX[TERRAIN_MAX_LEVELS], NodesZ[TERRAIN_MAX_LEVELS];
+  int32_t TilesX[TERRAIN_MAX_LEVELS], TilesZ[TERRAIN_MAX_LEVELS];
+  int64_t NodeOffset[TERRAIN_MAX_LEVELS]; // bytes, TerrainLevel::Heights of each level
+  int64_t TileOffset[TERRAIN_MAX_LEVELS]; // bytes, first tile of each mip
+  int64_t SourceTime, SourceSize;         // of the heightmap when baked
+  uint64_t SourceHash;                    // hash_file of the heightmap
+};
+
+// Out-of-core heightmap for a streamed Terrain. The tile file written by
+// Bake records the heightmap's size, time and hash, so Refresh bakes it
+// again after the heightmap was edited. It is memory mapped, so nothing is
+// read until a tile is needed, and the node heights are read straight
+// from the mapping while selecting.
+//
+// Tiles live in the layers of one texture array, a fixed budget of slots.
+// Terrain asks for the tile of every node it draws; missing ones are
+// queued for a loader thread, which copies them out of the mapping (where
+// the page faults and disk reads happen) into a small bounded staging
+// list. Update uploads the staged tiles once per frame into free slots or
+// ones not used this frame, least recently used first. The coarsest mip is
+// loaded up front and never evicted, so every node always has a tile to
+// fall back to. Memory use is the slots, the staging list and the page
+// cache, which the OS reclaims, however large the terrain is.
+class TerrainTileCache
+{
+public:
+  TerrainTileHeader Header;
+  GLuint Texture; // GL_TEXTURE_2D_ARRAY, one layer per slot
+  int Slots;
+
+  // Splits a grayscale heightmap into a tile file, returns false on failure
+  static bool Bake(const char *heightmap, const char *file);
+  // Bakes the tile file again when it is missing, of another version or its
+  // heightmap changed size or content since, returns false when that fails.
+  // A new modification time with the same content only refreshes the header.
+  static bool Refresh(const char *heightmap, const char *file);
+
+  // Maps a tile file and allocates the slots
+  TerrainTileCache(const char *file, int slots);
+  ~TerrainTileCache();
+  bool Valid() const { return this->Texture != 0; }
+  // Node heights of a level, in the mapping
+  const float *NodeHeights(int level) const;
+  // Layer of a resident tile, or -1 after queueing it for loading
+  int Acquire(int mip, int x, int z);
+  // Uploads the tiles loaded since the last call and queues this frame's
+  // misses for the loader, once per frame
+  void Update();
+  // Binds the texture array to a texture unit
+  void Bind(int unit) const;
+  // Tiles resident in the slots
+  int ResidentCount() const { return (int)this->Lookup.size(); }
+  // Stops the loader, deletes the texture and unmaps the file
+  void Release();
+
+private:
+  struct Slot
+  {
+    long long Key; // -1 when free
+    unsigned long LastUsed;
+    bool Pinned;   // coarsest mip, never evicted
+  };
+  mapped_file File;
+  std::vector<Slot> SlotTable;
+  std::unordered_map<long long, int> Lookup; // resident tile -> slot
+  std::vector<long long> Misses;             // this frame, in the order asked for
+  std::unordered_set<long long> Missed;
+  unsigned long Frame;
+
+  // shared with the loader
+  std::thread Loader;
+  std::mutex Mutex;
+  std::condition_variable Wake;
+  std::deque<long long> Queue;
+  std::vector<std::pair<long long, std::vector<unsigned char> > > Loaded;
+  std::unordered_set<long long> InFlight; // queued or loading
+  bool Quit;
+
+  TerrainTileCache(const TerrainTileCache &);
+  TerrainTileCache &operator=(const TerrainTileCache &);
+  static long long key(int mip, int x, int z);
+  const unsigned char *tileData(long long key) const;
+  bool upload(long long key, const unsigned char *data, bool pinned);
+  void run();
+};
+
+#endif
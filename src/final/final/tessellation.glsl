@@ -0,0 +1,41 @@
+// Level of detail shared by the tessellation control shaders: #include
+// "tessellation.glsl" after frame_data.glsl. Every edge is split so the
+// generated triangles span about tessTriangleSize pixels on screen, which
+// bounds the screen space error of the displaced surface: detail goes where
+// the patch is large on screen and nowhere else. An edge's level depends on
+// its two end points only, so the patches on both sides of it agree and no
+// cracks open between them.
+
+uniform vec2 viewportSize;      // in pixels
+uniform float tessTriangleSize; // wanted edge length of the generated triangles, in pixels
+
+// Tessellation level of the edge between two world space points: the pixels
+// its bounding sphere covers on screen over the wanted triangle size
+float EdgeLevel(vec3 a, vec3 b, float maxLevel)
+{
+    float radius = distance(a, b) * 0.5;
+    float dist = max(distance((a + b) * 0.5, viewPos), radius);
+    float pixels = 2.0 * radius * projection[1][1] * 0.5 * viewportSize.y / dist;
+    return clamp(pixels / tessTriangleSize, 1.0, maxLevel);
+}
+
+// Whether any part of a box in model space can be in the view: false when
+// all its corners are beyond the same clip plane
+bool PatchVisible(mat4 modelViewProjection, vec3 lo, vec3 hi)
+{
+    vec4 corners[8];
+    for (int i = 0; i < 8; i++)
+        corners[i] = modelViewProjection * vec4(mix(lo, hi, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1)), 1.0);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int below = 0, above = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            below += corners[i][axis] < -corners[i].w ? 1 : 0;
+            above += corners[i][axis] > corners[i].w ? 1 : 0;
+        }
+        if (below == 8 || above == 8)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,283 @@
+#include "text_atlas.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace
+{
+  // empty texels between glyphs, so linear filtering never blends in a neighbour
+  const int GLYPH_PADDING = 1;
+  const int ATLAS_WIDTH = 512;
+  // floats per vertex: position, texture coordinate, colour
+  const int TEXT_VERTEX_FLOATS = 7;
+
+  struct GlyphBitmap
+  {
+    int Code, Width, Rows;
+    std::vector<unsigned char> Pixels;
+  };
+}
+
+SkylinePacker::SkylinePacker(int width, int height)
+  : Width(width), Height(height)
+{
+  Segment floor = {0, 0, width};
+  this->Skyline.push_back(floor);
+}
+
+bool SkylinePacker::Insert(int width, int height, glm::ivec2 &position)
+{
+  // lowest resting place, leftmost among equals
+  int best = -1, bestX = 0, bestY = this->Height;
+  for (size_t i = 0; i < this->Skyline.size(); i++)
+  {
+    int x = this->Skyline[i].X;
+    if (x + width > this->Width)
+      break;
+    int y = 0;
+    for (size_t j = i; j < this->Skyline.size() && this->Skyline[j].X < x + width; j++)
+      y = std::max(y, this->Skyline[j].Y);
+    if (y + height <= this->Height && y < bestY)
+    {
+      best = (int)i;
+      bestX = x;
+      bestY = y;
+    }
+  }
+  if (best < 0)
+    return false;
+
+  // the rectangle's top replaces the segments under it
+  Segment top = {bestX, bestY + height, width};
+  this->Skyline.insert(this->Skyline.begin() + best, top);
+  for (size_t i = best + 1; i < this->Skyline.size();)
+  {
+    Segment &segment = this->Skyline[i];
+    int covered = top.X + top.Width - segment.X;
+    if (covered <= 0)
+      break;
+    if (segment.Width > covered)
+    {
+      segment.X += covered;
+      segment.Width -= covered;
+      break;
+    }
+    this->Skyline.erase(this->Skyline.begin() + i);
+  }
+  for (size_t i = 0; i + 1 < this->Skyline.size();)
+  {
+    if (this->Skyline[i].Y == this->Skyline[i + 1].Y)
+    {
+      this->Skyline[i].Width += this->Skyline[i + 1].Width;
+      this->Skyline.erase(this->Skyline.begin() + i + 1);
+    }
+    else
+      i++;
+  }
+  position = glm::ivec2(bestX, bestY);
+  return true;
+}
+
+GlyphAtlas::GlyphAtlas()
+  : Texture(0), Width(0), Height(0)
+{
+  for (int c = 0; c < GLYPH_COUNT; c++)
+  {
+    Glyph empty = {glm::ivec2(0), glm::ivec2(0), 0, glm::vec2(0.0f), glm::vec2(0.0f)};
+    this->Glyphs[c] = empty;
+  }
+}
+
+bool GlyphAtlas::Load(const char *font, int pixelSize)
+{
+  // All functions return a value different than 0 whenever an error occurred
+  FT_Library ft;
+  if (FT_Init_FreeType(&ft))
+  {
+    std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+    return false;
+  }
+  FT_Face face;
+  if (FT_New_Face(ft, font, 0, &face))
+  {
+    std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+    FT_Done_FreeType(ft);
+    return false;
+  }
+  FT_Set_Pixel_Sizes(face, 0, pixelSize);
+
+  std::vector<GlyphBitmap> bitmaps;
+  for (int c = 0; c < GLYPH_COUNT; c++)
+  {
+    if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+    {
+      std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+      continue;
+    }
+    FT_GlyphSlot slot = face->glyph;
+    Glyph &glyph = this->Glyphs[c];
+    glyph.Size = glm::ivec2(slot->bitmap.width, slot->bitmap.rows);
+    glyph.Bearing = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+    glyph.Advance = (GLuint)slot->advance.x;
+    if (slot->bitmap.width == 0 || slot->bitmap.rows == 0)
+      continue;
+    GlyphBitmap bitmap;
+    bitmap.Code = c;
+    bitmap.Width = slot->bitmap.width;
+    bitmap.Rows = slot->bitmap.rows;
+    // rows may be padded, copy them tightly
+    for (int row = 0; row < bitmap.Rows; row++)
+    {
+      const unsigned char *source = slot->bitmap.buffer + row * slot->bitmap.pitch;
+      bitmap.Pixels.insert(bitmap.Pixels.end(), source, source + bitmap.Width);
+    }
+    bitmaps.push_back(bitmap);
+  }
+  FT_Done_Face(face);
+  FT_Done_FreeType(ft);
+
+  // tallest first, into the shortest atlas they fit in
+  std::sort(bitmaps.begin(), bitmaps.end(), [](const GlyphBitmap &a, const GlyphBitmap &b) { return a.Rows > b.Rows; });
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  std::vector<glm::ivec2> positions(bitmaps.size());
+  bool packed = false;
+  for (this->Height = 64; this->Height <= maxSize; this->Height *= 2)
+  {
+    SkylinePacker packer(ATLAS_WIDTH, this->Height);
+    packed = true;
+    for (size_t i = 0; i < bitmaps.size() && packed; i++)
+      packed = packer.Insert(bitmaps[i].Width + GLYPH_PADDING, bitmaps[i].Rows + GLYPH_PADDING, positions[i]);
+    if (packed)
+      break;
+  }
+  if (!packed)
+  {
+    std::cout << "ERROR::GLYPH_ATLAS: The glyphs do not fit in a texture" << std::endl;
+    return false;
+  }
+  this->Width = ATLAS_WIDTH;
+  // keep only the rows the glyphs reached
+  int used = 1;
+  for (size_t i = 0; i < bitmaps.size(); i++)
+    used = std::max(used, positions[i].y + bitmaps[i].Rows + GLYPH_PADDING);
+  this->Height = used;
+
+  std::vector<unsigned char> pixels((size_t)this->Width * this->Height, 0);
+  for (size_t i = 0; i < bitmaps.size(); i++)
+  {
+    const GlyphBitmap &bitmap = bitmaps[i];
+    for (int row = 0; row < bitmap.Rows; row++)
+      std::copy(&bitmap.Pixels[(size_t)row * bitmap.Width], &bitmap.Pixels[(size_t)row * bitmap.Width] + bitmap.Width,
+                &pixels[(size_t)(positions[i].y + row) * this->Width + positions[i].x]);
+    Glyph &glyph = this->Glyphs[bitmap.Code];
+    glyph.UVMin = glm::vec2(positions[i]) / glm::vec2((float)this->Width, (float)this->Height);
+    glyph.UVMax = glm::vec2(positions[i] + glyph.Size) / glm::vec2((float)this->Width, (float)this->Height);
+  }
+
+  glGenTextures(1, &this->Texture);
+  glBindTexture(GL_TEXTURE_2D, this->Texture);
+  GLint alignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, this->Width, this->Height, 0, GL_RED, GL_UNSIGNED_BYTE, &pixels[0]);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+void GlyphAtlas::Release()
+{
+  glDeleteTextures(1, &this->Texture);
+  this->Texture = 0;
+}
+
+TextBatch::TextBatch(const GlyphAtlas *atlas)
+  : Atlas(atlas), VAO(0), VBO(0), Capacity(0)
+{
+  glGenVertexArrays(1, &this->VAO);
+  glGenBuffers(1, &this->VBO);
+  glBindVertexArray(this->VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, TEXT_VERTEX_FLOATS * sizeof(GLfloat), (void *)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, TEXT_VERTEX_FLOATS * sizeof(GLfloat), (void *)(4 * sizeof(GLfloat)));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+}
+
+void TextBatch::Add(const std::string &text, float x, float y, float scale, glm::vec3 color)
+{
+  for (std::string::const_iterator c = text.begin(); c != text.end(); c++)
+  {
+    unsigned char code = (unsigned char)*c;
+    if (code >= GLYPH_COUNT)
+      continue;
+    const Glyph &glyph = this->Atlas->Glyphs[code];
+    float xpos = x + glyph.Bearing.x * scale;
+    float ypos = y - (glyph.Size.y - glyph.Bearing.y) * scale;
+    float w = glyph.Size.x * scale;
+    float h = glyph.Size.y * scale;
+    // Advance is in 1/64 pixels
+    x += (glyph.Advance >> 6) * scale;
+    if (glyph.Size.x == 0 || glyph.Size.y == 0)
+      continue;
+
+    // the bitmap's first row is its top
+    const float quad[6][4] = {
+      {xpos, ypos + h, glyph.UVMin.x, glyph.UVMin.y},
+      {xpos, ypos, glyph.UVMin.x, glyph.UVMax.y},
+      {xpos + w, ypos, glyph.UVMax.x, glyph.UVMax.y},
+
+      {xpos, ypos + h, glyph.UVMin.x, glyph.UVMin.y},
+      {xpos + w, ypos, glyph.UVMax.x, glyph.UVMax.y},
+      {xpos + w, ypos + h, glyph.UVMax.x, glyph.UVMin.y}};
+    for (int v = 0; v < 6; v++)
+    {
+      this->Vertices.insert(this->Vertices.end(), quad[v], quad[v] + 4);
+      this->Vertices.push_back(color.x);
+      this->Vertices.push_back(color.y);
+      this->Vertices.push_back(color.z);
+    }
+  }
+}
+
+void TextBatch::Draw(Shader &shader)
+{
+  if (this->Vertices.empty())
+    return;
+  shader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, this->Atlas->Texture);
+  glBindVertexArray(this->VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+  // grow to the largest batch seen, otherwise refill the storage in place
+  if (this->Vertices.size() > this->Capacity)
+  {
+    this->Capacity = this->Vertices.size();
+    glBufferData(GL_ARRAY_BUFFER, this->Capacity * sizeof(GLfloat), &this->Vertices[0], GL_DYNAMIC_DRAW);
+  }
+  else
+    glBufferSubData(GL_ARRAY_BUFFER, 0, this->Vertices.size() * sizeof(GLfloat), &this->Vertices[0]);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(this->Vertices.size() / TEXT_VERTEX_FLOATS));
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  this->Vertices.clear();
+}
+
+void TextBatch::Release()
+{
+  glDeleteVertexArrays(1, &this->VAO);
+  glDeleteBuffers(1, &this->VBO);
+  this->VAO = this->VBO = 0;
+  this->Capacity = 0;
+}
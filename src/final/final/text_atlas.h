@@ -0,0 +1,85 @@
+#ifndef TEXT_ATLAS_H
+#define TEXT_ATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include <learnopengl/shader.h>
+
+// Glyphs loaded per font, the ASCII set
+const int GLYPH_COUNT = 128;
+
+// A glyph's bitmap in the atlas and its placement on the baseline
+struct Glyph
+{
+  glm::ivec2 Size;        // of the bitmap, in pixels
+  glm::ivec2 Bearing;     // offset from the baseline to the left/top of the bitmap
+  GLuint Advance;         // to the next glyph, in 1/64 pixels
+  glm::vec2 UVMin, UVMax; // of the bitmap in the atlas, top left and bottom right
+};
+
+// Skyline rectangle packer: the packed area is kept as the outline of its
+// top edge, a list of horizontal segments from left to right. A rectangle
+// goes where it rests lowest on that outline, which wastes little space
+// for glyphs of similar heights inserted tallest first.
+class SkylinePacker
+{
+public:
+  SkylinePacker(int width, int height);
+  // Top left corner for a rectangle, false when it does not fit
+  bool Insert(int width, int height, glm::ivec2 &position);
+
+private:
+  struct Segment
+  {
+    int X, Y, Width;
+  };
+  int Width, Height;
+  std::vector<Segment> Skyline;
+};
+
+// The glyphs of a font at one pixel size, rendered with FreeType and packed
+// into a single GL_R8 texture at load, so text of any length draws from one
+// texture.
+class GlyphAtlas
+{
+public:
+  GLuint Texture;
+  int Width, Height;
+  Glyph Glyphs[GLYPH_COUNT];
+
+  GlyphAtlas();
+  // Renders and packs the ASCII glyphs, false (after printing why) on failure
+  bool Load(const char *font, int pixelSize);
+  // Deletes the texture
+  void Release();
+};
+
+// Quads of any number of strings collected in one vertex buffer and drawn
+// with a single call, each string in its own colour. text.vs and text.fs
+// take position, texture coordinate and colour per vertex.
+class TextBatch
+{
+public:
+  explicit TextBatch(const GlyphAtlas *atlas);
+  // Appends a string with its baseline starting at (x, y), in pixels
+  void Add(const std::string &text, float x, float y, float scale, glm::vec3 color);
+  // Draws the strings added since the last Draw and empties the batch
+  void Draw(Shader &shader);
+  // Deletes the buffers
+  void Release();
+
+private:
+  const GlyphAtlas *Atlas;
+  GLuint VAO, VBO;
+  size_t Capacity;             // floats the buffer holds
+  std::vector<float> Vertices; // x, y, u, v, r, g, b each
+
+  TextBatch(const TextBatch &);
+  TextBatch &operator=(const TextBatch &);
+};
+
+#endif
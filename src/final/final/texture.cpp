@@ -11,18 +11,24 @@
 #include "texture.h"
 
 Texture2D::Texture2D()
-    : Width(0), Height(0), Internal_Format(GL_RGB), Image_Format(GL_RGB), Wrap_S(GL_REPEAT), Wrap_T(GL_REPEAT), Filter_Min(GL_LINEAR), Filter_Max(GL_LINEAR)
+    : ID(0), Width(0), Height(0), Internal_Format(GL_RGB), Image_Format(GL_RGB), Wrap_S(GL_REPEAT), Wrap_T(GL_REPEAT), Filter_Min(GL_LINEAR), Filter_Max(GL_LINEAR)
 {
-	glGenTextures(1, &this->ID);
 }
 
 void Texture2D::Generate(int width, int height, unsigned char *data)
 {
   this->Width = width;
   this->Height = height;
-  // Create Texture
+  // Create Texture (lazily, so copies and default constructed entries never leak a name)
+  if (this->ID == 0)
+    glGenTextures(1, &this->ID);
   glBindTexture(GL_TEXTURE_2D, this->ID);
+  // stb_image rows are tightly packed, RGB ones need not be 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glTexImage2D(GL_TEXTURE_2D, 0, this->Internal_Format, width, height, 0, this->Image_Format, GL_UNSIGNED_BYTE, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (this->Mipmapped())
+    glGenerateMipmap(GL_TEXTURE_2D);
   // Set Texture wrap and filter modes
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->Wrap_S);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->Wrap_T);
@@ -32,7 +38,19 @@ void Texture2D::Generate(int width, int height, unsigned char *data)
   glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+bool Texture2D::Mipmapped() const
+{
+  return this->Filter_Min != GL_NEAREST && this->Filter_Min != GL_LINEAR;
+}
+
 void Texture2D::Bind() const
 {
   glBindTexture(GL_TEXTURE_2D, this->ID);
+}
+
+void Texture2D::Release()
+{
+  if (this->ID != 0)
+    glDeleteTextures(1, &this->ID);
+  this->ID = 0;
 }
\ No newline at end of file
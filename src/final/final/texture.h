@@ -27,10 +27,14 @@ public:
   int Wrap_T;     // Wrapping mode on T axis
   int Filter_Min; // Filtering mode if texture pixels < screen pixels
   int Filter_Max; // Filtering mode if texture pixels > screen pixels
-  // Constructor (sets default texture modes)
+  // Constructor (sets default texture modes). No GL name is allocated until Generate is called
   Texture2D();
-  // Generates texture from image data
+  // Generates texture from image data, with a full mip chain when Filter_Min is a mipmap filter
   void Generate(int width, int height, unsigned char *data);
+  // True when Filter_Min samples mip levels, so Generate builds them
+  bool Mipmapped() const;
+  // Deletes the GL texture object (if any) so the name can be regenerated later
+  void Release();
   // Binds the texture as the current active GL_TEXTURE_2D texture object
   void Bind() const;
 };
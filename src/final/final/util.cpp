@@ -2,6 +2,18 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "util.h"
 
 void *file_contents(const char *filename, GLint *length)
 {
@@ -107,3 +119,129 @@ void *read_tga(const char *filename, int *width, int *height)
 
     return pixels;
 }
+
+unsigned long long hash_bytes(const void *data, size_t size, unsigned long long h)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool file_info(const char *filename, long long *time, long long *size)
+{
+    struct stat info;
+    if (stat(filename, &info) != 0)
+        return false;
+    *time = (long long)info.st_mtime;
+    *size = (long long)info.st_size;
+    return true;
+}
+
+bool hash_file(const char *filename, unsigned long long *hash)
+{
+    FILE *f;
+    unsigned char buffer[65536];
+    size_t read;
+
+    if (fopen_s(&f, filename, "rb") != 0 || !f)
+        return false;
+    *hash = hash_bytes(NULL, 0);
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        *hash = hash_bytes(buffer, read, *hash);
+    fclose(f);
+    return true;
+}
+
+void parallel_for(int count, const std::function<void(int, int)> &body)
+{
+    int threads = (int)std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+    if (threads > count)
+        threads = count;
+    if (threads <= 1) {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    // the calling thread takes the first range
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i)
+        workers.push_back(std::thread(body, count * i / threads, count * (i + 1) / threads));
+    body(0, count / threads);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+bool map_file(const char *filename, mapped_file *file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+#ifdef _WIN32
+    HANDLE f = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Unable to open %s for mapping\n", filename);
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(f, &size);
+    HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(f);
+    if (!mapping) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        return false;
+    }
+    file->data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!file->data) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        CloseHandle(mapping);
+        return false;
+    }
+    file->size = (size_t)size.QuadPart;
+    file->handle = mapping;
+#else
+    int f = open(filename, O_RDONLY);
+    if (f < 0) {
+        fprintf(stderr, "Unable to open %s for mapping\n", filename);
+        return false;
+    }
+    struct stat info;
+    if (fstat(f, &info) != 0 || info.st_size == 0) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        close(f);
+        return false;
+    }
+    // the mapping keeps the file referenced after the descriptor is closed
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+    close(f);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", filename);
+        return false;
+    }
+    file->data = (const unsigned char *)data;
+    file->size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void unmap_file(mapped_file *file)
+{
+    if (!file->data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(file->data);
+    CloseHandle((HANDLE)file->handle);
+#else
+    munmap((void *)file->data, file->size);
+#endif
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+}
@@ -1,2 +1,33 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <functional>
+
 void *file_contents(const char *filename, GLint *length);
-void *read_tga(const char *filename, int *width, int *height);
\ No newline at end of file
+void *read_tga(const char *filename, int *width, int *height);
+
+// 64-bit FNV-1a, pass the previous result as h to hash several buffers in sequence
+unsigned long long hash_bytes(const void *data, size_t size, unsigned long long h = 14695981039346656037ULL);
+
+// Modification time and size of a file, returns false when it does not exist
+bool file_info(const char *filename, long long *time, long long *size);
+// hash_bytes of a whole file, returns false when it cannot be read
+bool hash_file(const char *filename, unsigned long long *hash);
+
+// Splits [0, count) into contiguous ranges and runs body(begin, end) for each
+// on its own thread, one range per hardware thread. Returns when all are done.
+void parallel_for(int count, const std::function<void(int, int)> &body);
+
+// Read-only memory mapping of a whole file, pages are read in on first access
+struct mapped_file {
+    const unsigned char *data;
+    size_t size;
+    void *handle; // the file mapping object on Windows
+};
+
+// Maps a file, returns false (and prints why) when it cannot be opened
+bool map_file(const char *filename, mapped_file *file);
+void unmap_file(mapped_file *file);
+
+#endif
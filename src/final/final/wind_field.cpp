@@ -0,0 +1,309 @@
+#include "wind_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef WIND_FIELD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  // log2(WIND_FIELD_SIZE), rows are addressed with a shift
+  const int SIZE_SHIFT = 6;
+  static_assert(WIND_FIELD_SIZE == 1 << SIZE_SHIFT, "WIND_FIELD_SIZE must be 1 << SIZE_SHIFT");
+  // cells per side of the noise lattice feeding the gusts, a power of two
+  const int NOISE_CELLS = 8;
+  // lattice values change this many times per second
+  const float NOISE_RATE = 0.5f;
+  // seconds until a gust has decayed to 1/e
+  const float GUST_LIFETIME = 4.0f;
+  // noise fed into the fields per second, the gusts settle around GUST_FEED * GUST_LIFETIME
+  const float GUST_FEED = 0.25f;
+  // longest step simulated at once, in seconds
+  const float MAX_STEP = 0.1f;
+
+  // Pseudo-random value in [-1, 1] of a lattice cell at a time step
+  float hashNoise(int cell, int step, int channel)
+  {
+    unsigned int h = (unsigned int)cell * 73856093u ^ (unsigned int)step * 19349663u ^ (unsigned int)channel * 83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (h & 0xffff) / 32767.5f - 1.0f;
+  }
+
+  // IEEE half float, truncated, tiny values flushed to zero
+  unsigned short toHalf(float value)
+  {
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    if (exponent <= 0)
+      return sign;
+    if (exponent >= 31)
+      return sign | 0x7c00;
+    return sign | (unsigned short)(exponent << 10) | (unsigned short)((bits & 0x7fffff) >> 13);
+  }
+
+#ifdef WIND_FIELD_SSE
+  inline __m128 gather(const float *field, const int *index)
+  {
+    return _mm_set_ps(field[index[3]], field[index[2]], field[index[1]], field[index[0]]);
+  }
+
+  inline __m128 lerp(__m128 a, __m128 b, __m128 t)
+  {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+  }
+#endif
+}
+
+WindField::WindField(glm::vec2 origin, float extent, glm::vec2 mean)
+  : Texture(0), Origin(origin), Extent(extent), Mean(mean), Clock(0.0f), Busy(false), Ready(false), Quit(false),
+    Elapsed(0.0f), StepTime(0.0f)
+{
+  const int texels = WIND_FIELD_SIZE * WIND_FIELD_SIZE;
+  this->Gust.assign(texels, 0.0f);
+  this->Cross.assign(texels, 0.0f);
+  this->U.assign(texels, mean.x);
+  this->V.assign(texels, mean.y);
+  this->Scratch[0].resize(texels);
+  this->Scratch[1].resize(texels);
+  this->Front.resize(2 * texels);
+  this->Back.resize(2 * texels);
+  for (int i = 0; i < texels; i++)
+  {
+    this->Front[2 * i] = toHalf(mean.x);
+    this->Front[2 * i + 1] = toHalf(mean.y);
+  }
+
+  glGenTextures(1, &this->Texture);
+  glBindTexture(GL_TEXTURE_2D, this->Texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, WIND_FIELD_SIZE, WIND_FIELD_SIZE, 0, GL_RG, GL_HALF_FLOAT, &this->Front[0]);
+  // the simulated area wraps around
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  this->Worker = std::thread(&WindField::run, this);
+}
+
+WindField::~WindField()
+{
+  this->Release();
+}
+
+void WindField::Update(float deltaTime)
+{
+  bool upload = false;
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (this->Ready)
+    {
+      this->Front.swap(this->Back);
+      this->Ready = false;
+      upload = true;
+    }
+    // a slow step is not waited for, its time goes to the next one
+    this->Elapsed += deltaTime;
+    if (!this->Busy && !this->Quit)
+    {
+      this->StepTime = this->Elapsed;
+      this->Elapsed = 0.0f;
+      this->Busy = true;
+      this->Wake.notify_one();
+    }
+  }
+  // the worker only writes Back, so Front is uploaded unlocked
+  if (upload)
+  {
+    glBindTexture(GL_TEXTURE_2D, this->Texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIND_FIELD_SIZE, WIND_FIELD_SIZE, GL_RG, GL_HALF_FLOAT, &this->Front[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+}
+
+void WindField::SetUniforms(GLuint program, int unit) const
+{
+  glUniform1i(glGetUniformLocation(program, "windField"), unit);
+  glUniform4f(glGetUniformLocation(program, "windFieldArea"), this->Origin.x, this->Origin.y, 1.0f / this->Extent, 1.0f / this->Extent);
+}
+
+void WindField::Bind(int unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, this->Texture);
+}
+
+void WindField::Release()
+{
+  if (this->Worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Quit = true;
+    }
+    this->Wake.notify_one();
+    this->Worker.join();
+  }
+  glDeleteTextures(1, &this->Texture);
+  this->Texture = 0;
+}
+
+void WindField::run()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  while (true)
+  {
+    this->Wake.wait(lock, [this] { return this->Busy || this->Quit; });
+    if (this->Quit)
+      return;
+    float dt = this->StepTime;
+    lock.unlock();
+    this->step(dt);
+    lock.lock();
+    this->Busy = false;
+    this->Ready = true;
+  }
+}
+
+void WindField::step(float dt)
+{
+  const int n = WIND_FIELD_SIZE;
+  dt = std::min(dt, MAX_STEP);
+  this->Clock += dt;
+  float decay = std::exp(-dt / GUST_LIFETIME);
+  float feed = dt * GUST_FEED;
+  // texels the wind moves in this step per world unit of wind
+  float scale = dt * n / this->Extent;
+
+  // the noise lattice at this time, eased between two random steps
+  float lattice[2][NOISE_CELLS * NOISE_CELLS];
+  float time = this->Clock * NOISE_RATE;
+  int now = (int)std::floor(time);
+  float blend = time - now;
+  blend = blend * blend * (3.0f - 2.0f * blend);
+  for (int c = 0; c < 2; c++)
+    for (int i = 0; i < NOISE_CELLS * NOISE_CELLS; i++)
+      lattice[c][i] = hashNoise(i, now, c) + (hashNoise(i, now + 1, c) - hashNoise(i, now, c)) * blend;
+
+  const float *gust = &this->Gust[0], *cross = &this->Cross[0];
+  float *nextGust = &this->Scratch[0][0], *nextCross = &this->Scratch[1][0];
+  for (int y = 0; y < n; y++)
+  {
+    // the lattice row of this texel row, with the first cell repeated at the end
+    float ly = (y + 0.5f) * NOISE_CELLS / n - 0.5f + NOISE_CELLS;
+    int ly0 = (int)ly;
+    float fy = ly - ly0;
+    ly0 &= NOISE_CELLS - 1;
+    int ly1 = (ly0 + 1) & (NOISE_CELLS - 1);
+    float noise[2][NOISE_CELLS + 1];
+    for (int c = 0; c < 2; c++)
+    {
+      for (int i = 0; i < NOISE_CELLS; i++)
+        noise[c][i] = lattice[c][i + ly0 * NOISE_CELLS] + (lattice[c][i + ly1 * NOISE_CELLS] - lattice[c][i + ly0 * NOISE_CELLS]) * fy;
+      noise[c][NOISE_CELLS] = noise[c][0];
+    }
+
+    int row = y << SIZE_SHIFT;
+#ifdef WIND_FIELD_SSE
+    const __m128 size = _mm_set1_ps((float)n), reach = _mm_set1_ps(n - 1.0f), back = _mm_set1_ps(1.0f - n);
+    const __m128i mask = _mm_set1_epi32(n - 1), one = _mm_set1_epi32(1);
+    const __m128 scaleV = _mm_set1_ps(scale), decayV = _mm_set1_ps(decay), feedV = _mm_set1_ps(feed);
+    for (int x = 0; x < n; x += 4)
+    {
+      __m128 lane = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+      // trace back along the wind, shifted by n so that truncation floors
+      __m128 dx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&this->U[row + x]), scaleV), back), reach);
+      __m128 dy = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&this->V[row + x]), scaleV), back), reach);
+      __m128 px = _mm_add_ps(_mm_sub_ps(lane, dx), size);
+      __m128 py = _mm_add_ps(_mm_sub_ps(_mm_set1_ps((float)y), dy), size);
+      __m128i ix = _mm_cvttps_epi32(px), iy = _mm_cvttps_epi32(py);
+      __m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(ix)), fyV = _mm_sub_ps(py, _mm_cvtepi32_ps(iy));
+      __m128i x0 = _mm_and_si128(ix, mask), x1 = _mm_and_si128(_mm_add_epi32(ix, one), mask);
+      __m128i y0 = _mm_slli_epi32(_mm_and_si128(iy, mask), SIZE_SHIFT);
+      __m128i y1 = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(iy, one), mask), SIZE_SHIFT);
+      alignas(16) int corner[4][4];
+      _mm_store_si128((__m128i *)corner[0], _mm_add_epi32(x0, y0));
+      _mm_store_si128((__m128i *)corner[1], _mm_add_epi32(x1, y0));
+      _mm_store_si128((__m128i *)corner[2], _mm_add_epi32(x0, y1));
+      _mm_store_si128((__m128i *)corner[3], _mm_add_epi32(x1, y1));
+
+      // the noise along the row
+      __m128 lx = _mm_add_ps(_mm_mul_ps(lane, _mm_set1_ps((float)NOISE_CELLS / n)), _mm_set1_ps(0.5f * NOISE_CELLS / n - 0.5f + NOISE_CELLS));
+      __m128i nx = _mm_cvttps_epi32(lx);
+      __m128 nfx = _mm_sub_ps(lx, _mm_cvtepi32_ps(nx));
+      alignas(16) int cell[4];
+      _mm_store_si128((__m128i *)cell, _mm_and_si128(nx, _mm_set1_epi32(NOISE_CELLS - 1)));
+      alignas(16) int nextCell[4] = {cell[0] + 1, cell[1] + 1, cell[2] + 1, cell[3] + 1};
+
+      const float *fields[2] = {gust, cross};
+      float *targets[2] = {nextGust, nextCross};
+      for (int f = 0; f < 2; f++)
+      {
+        __m128 top = lerp(gather(fields[f], corner[0]), gather(fields[f], corner[1]), fx);
+        __m128 bottom = lerp(gather(fields[f], corner[2]), gather(fields[f], corner[3]), fx);
+        __m128 source = lerp(gather(noise[f], cell), gather(noise[f], nextCell), nfx);
+        __m128 value = _mm_add_ps(_mm_mul_ps(lerp(top, bottom, fyV), decayV), _mm_mul_ps(source, feedV));
+        _mm_storeu_ps(&targets[f][row + x], value);
+      }
+    }
+#else
+    for (int x = 0; x < n; x++)
+    {
+      float dx = glm::clamp(this->U[row + x] * scale, 1.0f - n, n - 1.0f);
+      float dy = glm::clamp(this->V[row + x] * scale, 1.0f - n, n - 1.0f);
+      float px = x - dx + n, py = y - dy + n;
+      int ix = (int)px, iy = (int)py;
+      float fx = px - ix, fyT = py - iy;
+      int x0 = ix & (n - 1), x1 = (ix + 1) & (n - 1);
+      int y0 = (iy & (n - 1)) << SIZE_SHIFT, y1 = ((iy + 1) & (n - 1)) << SIZE_SHIFT;
+      float lx = (x + 0.5f) * NOISE_CELLS / n - 0.5f + NOISE_CELLS;
+      int nx = (int)lx;
+      float nfx = lx - nx;
+      nx &= NOISE_CELLS - 1;
+
+      const float *fields[2] = {gust, cross};
+      float *targets[2] = {nextGust, nextCross};
+      for (int f = 0; f < 2; f++)
+      {
+        const float *field = fields[f];
+        float top = field[x0 + y0] + (field[x1 + y0] - field[x0 + y0]) * fx;
+        float bottom = field[x0 + y1] + (field[x1 + y1] - field[x0 + y1]) * fx;
+        float source = noise[f][nx] + (noise[f][nx + 1] - noise[f][nx]) * nfx;
+        targets[f][row + x] = (top + (bottom - top) * fyT) * decay + source * feed;
+      }
+    }
+#endif
+  }
+  this->Gust.swap(this->Scratch[0]);
+  this->Cross.swap(this->Scratch[1]);
+
+  // the wind: the mean scaled by the gust plus the crosswind at right angles
+  const int texels = n * n;
+#ifdef WIND_FIELD_SSE
+  const __m128 meanX = _mm_set1_ps(this->Mean.x), meanY = _mm_set1_ps(this->Mean.y), oneV = _mm_set1_ps(1.0f);
+  for (int i = 0; i < texels; i += 4)
+  {
+    __m128 g = _mm_add_ps(_mm_loadu_ps(&this->Gust[i]), oneV), c = _mm_loadu_ps(&this->Cross[i]);
+    _mm_storeu_ps(&this->U[i], _mm_sub_ps(_mm_mul_ps(meanX, g), _mm_mul_ps(meanY, c)));
+    _mm_storeu_ps(&this->V[i], _mm_add_ps(_mm_mul_ps(meanY, g), _mm_mul_ps(meanX, c)));
+  }
+#else
+  for (int i = 0; i < texels; i++)
+  {
+    float g = 1.0f + this->Gust[i], c = this->Cross[i];
+    this->U[i] = this->Mean.x * g - this->Mean.y * c;
+    this->V[i] = this->Mean.y * g + this->Mean.x * c;
+  }
+#endif
+  for (int i = 0; i < texels; i++)
+  {
+    this->Back[2 * i] = toHalf(this->U[i]);
+    this->Back[2 * i + 1] = toHalf(this->V[i]);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef WIND_FIELD_H
+#define WIND_FIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIND_FIELD_SSE 1
+#endif
+
+// Texels per side of the simulated grid, a power of two and a multiple of 4
+const int WIND_FIELD_SIZE = 64;
+
+// Low resolution 2D wind over an area of the xz plane, shared by everything
+// that sways in the wind. Two scalar fields, the gust strength along the
+// mean wind and the crosswind, are advected semi-Lagrangian through the
+// wind they make, decay and are fed by drifting value noise, so gusts
+// travel across the area and bend with it. The area wraps around.
+//
+// The simulation runs on a worker thread, four texels at a time with SSE.
+// Update hands it the elapsed time and uploads the last finished step
+// as an RG16F texture (wind x and z in world units), so the frame never
+// waits for it.
+class WindField
+{
+public:
+  GLuint Texture;
+  glm::vec2 Origin; // xz corner of the area
+  float Extent;     // side of the area
+  glm::vec2 Mean;   // mean wind
+
+  WindField(glm::vec2 origin, float extent, glm::vec2 mean);
+  ~WindField();
+  // Uploads the last finished step and starts the next one, once per frame
+  void Update(float deltaTime);
+  // Sets windField and windFieldArea of a program in use, once after it is created
+  void SetUniforms(GLuint program, int unit) const;
+  // Binds the texture to a unit
+  void Bind(int unit) const;
+  // Stops the worker and deletes the texture
+  void Release();
+
+private:
+  // simulation state, only touched by the worker
+  std::vector<float> Gust, Cross, U, V, Scratch[2];
+  float Clock;
+  // packed half floats: Front is uploaded, Back written by the worker
+  std::vector<unsigned short> Front, Back;
+  std::thread Worker;
+  std::mutex Mutex;
+  std::condition_variable Wake;
+  bool Busy, Ready, Quit;
+  float Elapsed, StepTime;
+
+  WindField(const WindField &);
+  WindField &operator=(const WindField &);
+  void run();
+  void step(float dt);
+};
+
+#endif
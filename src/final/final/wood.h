@@ -19,7 +19,7 @@ public:
 		glm::mat4 model(1.0f);
 		model = glm::translate(model, this->Position);
 		model = glm::scale(model, this->Size);
-		shader->setMat4("model", model);
+		glUniformMatrix4fv(this->ModelLocation.Get(shader->ID), 1, GL_FALSE, glm::value_ptr(model));
 		auto texture = ResourceManager::GetTexture("wood");
 		glActiveTexture(GL_TEXTURE0);
 		texture.Bind();